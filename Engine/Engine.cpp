@@ -1,7 +1,11 @@
 #include "Engine.h"
 
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <mutex>
 
 #include "Utility.h"
 #include "../ZLibFile/ZLibFile.h"
@@ -247,11 +251,20 @@ bool Engine::saveTagger(const std::string& fileName) const
 
     zfile.writePtr(MAGIC, sizeof(MAGIC));
 
-    zfile.write(wordsCollection.wordsSize());
+    zfile.write(WordId(wordsCollection.wordsSize()));
     zfile.write(tagsCollection.tagsSize());
+    zfile.write(taggerOrder);
+    zfile.write(uint8_t(hmm.getStorage()));
 
     hmm.saveBinary(zfile);
 
+    if (taggerOrder == 3)
+    {
+        hmm3.saveBinary(zfile);
+    }
+
+    suffixTrie.saveBinary(zfile);
+
     return true;
 }
 
@@ -277,15 +290,47 @@ bool Engine::loadTagger(const std::string& fileName)
 
     WordId wordsSize = 0;
     TagId tagsSize = 0;
+    uint8_t order = 0;
+    uint8_t storage = 0;
 
-    if (!zfile.read(wordsSize) || !zfile.read(tagsSize))
+    if (!zfile.read(wordsSize) || !zfile.read(tagsSize) || !zfile.read(order) || !zfile.read(storage))
     {
         return false;
     }
 
-    hmm.resize(tagsSize, wordsSize);
+    if (!validStorage(storage))
+    {
+        spdlog::error("Tagger storage {} is not supported", storage);
+        return false;
+    }
 
-    return hmm.loadBinary(zfile);
+    if (order != 2 && order != 3)
+    {
+        spdlog::error("Tagger of order {} is not supported", order);
+        return false;
+    }
+
+    // The current tagger is kept unless the whole file is read
+    HMM<float, TagId, WordId> loadedHMM(tagsSize, wordsSize);
+    TrigramHMM<float, TagId, WordId> loadedHMM3;
+    SuffixTrie<float, TagId> loadedSuffixTrie;
+
+    if (!loadedHMM.loadBinary(zfile)
+        || loadedHMM.getStorage() != Storage(storage)
+        || (order == 3 && !loadedHMM3.loadBinary(zfile))
+        || !loadedSuffixTrie.loadBinary(zfile))
+    {
+        spdlog::error("Could not load tagger: {}", fileName);
+        return false;
+    }
+
+    hmm.swap(loadedHMM);
+    hmm3.swap(loadedHMM3);
+    suffixTrie.swap(loadedSuffixTrie);
+    taggerOrder = order;
+    tagStream.reset();
+
+    return true;
 }
 
 bool Engine::parseDirectory(const std::string& path, const std::string& parserName)
@@ -348,7 +393,8 @@ bool Engine::parse(const std::string& path, const std::string& parserName)
     spdlog::info("Sentences loaded: {}", sentences.size());
     spdlog::info("Words loaded: {}", wordsCollection.wordsSize());
     const auto wp = wordsCollection.maxTagsPerWord();
-    spdlog::info("Maximum tags per word loaded: {} -> {}", wp.second, *wordsCollection.index2word(wp.first));
+    const auto maxTagsWord = wordsCollection.index2word(wp.first);
+    spdlog::info("Maximum tags per word loaded: {} -> {}", wp.second, maxTagsWord ? *maxTagsWord : std::string());
     spdlog::info("Tags loaded: {}", tagsCollection.tagsSize());
     spdlog::info("Dependency relations loaded: {}", depRelsCollection.depRelsSize());
     
@@ -360,7 +406,7 @@ bool Engine::parse(const std::string& path, const std::string& parserName)
     return true;
 }
 
-void Engine::trainHMMOnSentence(const Sentence& sentence)
+void Engine::trainHMMOnSentence(const Sentence& sentence, HMM<float, TagId, WordId>::Counts& counts) const
 {
     if (sentence.words.empty())
     {
@@ -368,65 +414,478 @@ void Engine::trainHMMOnSentence(const Sentence& sentence)
         return;
     }
 
-    hmm.addHiddenState2HiddenState(tagsCollection.serviceTag(), tagsCollection.serviceTag());
-    hmm.addHiddenState2Emission(sentence.words[0].tags, sentence.words[0].word);
+    counts.addHiddenState2HiddenState(tagsCollection.serviceTag(), tagsCollection.serviceTag());
+    counts.addHiddenState2Emission(sentence.words[0].tags, sentence.words[0].word);
 
     for (size_t wix = 1; wix < sentence.words.size(); ++wix)
     {
-        hmm.addHiddenState2HiddenState(sentence.words[wix-1].tags, sentence.words[wix].tags);
-        hmm.addHiddenState2Emission(sentence.words[wix].tags, sentence.words[wix].word);
+        counts.addHiddenState2HiddenState(sentence.words[wix-1].tags, sentence.words[wix].tags);
+        counts.addHiddenState2Emission(sentence.words[wix].tags, sentence.words[wix].word);
     }
 
-    hmm.addHiddenState2HiddenState(sentence.words[sentence.words.size() - 1].tags, tagsCollection.serviceTag());
-    hmm.addHiddenState2Emission(tagsCollection.serviceTag(), wordsCollection.serviceWord());
+    counts.addHiddenState2HiddenState(sentence.words[sentence.words.size() - 1].tags, tagsCollection.serviceTag());
+    counts.addHiddenState2Emission(tagsCollection.serviceTag(), wordsCollection.serviceWord());
 }
 
 
-bool Engine::trainTagger(float smoothingFactor)
+void Engine::trainTrigramHMMOnSentence(const Sentence& sentence, TrigramHMM<float, TagId, WordId>::Counts& counts) const
+{
+    if (sentence.words.empty())
+    {
+        return;
+    }
+
+    const TagId service = tagsCollection.serviceTag();
+    TagId hs2 = service;
+    TagId hs1 = service;
+
+    for (const auto& word: sentence.words)
+    {
+        counts.addHiddenStates(hs2, hs1, word.tags);
+        hs2 = hs1;
+        hs1 = word.tags;
+    }
+
+    counts.addHiddenStates(hs2, hs1, service);
+}
+
+void Engine::addSuffixes(size_t first)
 {
+    // Suffixes of rare words are the best guess for unknown ones. Frequencies come from the counts kept by the tagger,
+    // they cover everything it was trained on, not only the sentences added now.
+    std::vector<size_t> frequencies(wordsCollection.wordsSize(), 0);
+    hmm.getCounts().addEmissionFrequencies(frequencies);
+
+    for (size_t i = first; i < sentences.size(); ++i)
+    {
+        for (const auto& word: sentences[i].words)
+        {
+            if (frequencies[word.word] > rareWordFrequency || word.word == wordsCollection.unknownWord())
+            {
+                continue;
+            }
+
+            if (const auto form = wordsCollection.index2word(word.word))
+            {
+                suffixTrie.add(*form, word.tags);
+            }
+        }
+    }
+
+    suffixTrie.finalize();
+}
+
+void Engine::countTaggerSentences(size_t first, Printer& printer)
+{
+    const TagId tagsSize = tagsCollection.tagsSize();
+
+    // Every worker counts into its own buffers, counts are integers so merging them gives the serial result
+    std::vector<HMM<float, TagId, WordId>::Counts> counts(threadPool.size(), HMM<float, TagId, WordId>::Counts(tagsSize));
+    std::vector<TrigramHMM<float, TagId, WordId>::Counts> counts3(threadPool.size(), TrigramHMM<float, TagId, WordId>::Counts(tagsSize));
+    std::mutex printerMutex;
+
+    threadPool.parallelFor(sentences.size() - first, [&](size_t begin, size_t end, size_t worker)
+    {
+        for (size_t i = first + begin; i < first + end; ++i)
+        {
+            trainHMMOnSentence(sentences[i], counts[worker]);
+            if (taggerOrder == 3)
+            {
+                trainTrigramHMMOnSentence(sentences[i], counts3[worker]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(printerMutex);
+        printer.incProgress(end - begin);
+    });
+
+    for (size_t worker = 0; worker < threadPool.size(); ++worker)
+    {
+        hmm.merge(counts[worker]);
+        if (taggerOrder == 3)
+        {
+            hmm3.merge(counts3[worker]);
+        }
+    }
+}
+
+bool Engine::trainTagger(float smoothingFactor, size_t order)
+{
+    if (order != 2 && order != 3)
+    {
+        spdlog::error("Tagger of order {} is not supported", order);
+        return false;
+    }
+
     Printer printer("Training tagger", sentences.size() + 1);
 
+    taggerOrder = order;
+
     hmm.resize(tagsCollection.tagsSize(), wordsCollection.wordsSize());
+    hmm3.resize(order == 3 ? tagsCollection.tagsSize() : 0);
+    tagStream.reset();
 
-    trainHMMOnSentence(unkWordOnly);
+    HMM<float, TagId, WordId>::Counts unkCounts(tagsCollection.tagsSize());
+    trainHMMOnSentence(unkWordOnly, unkCounts);
+    hmm.merge(unkCounts);
 
-    for (const auto& sentence: sentences)
+    if (order == 3)
     {
-        printer.incProgress();
-        trainHMMOnSentence(sentence);
+        TrigramHMM<float, TagId, WordId>::Counts unkCounts3(tagsCollection.tagsSize());
+        trainTrigramHMMOnSentence(unkWordOnly, unkCounts3);
+        hmm3.merge(unkCounts3);
     }
 
+    countTaggerSentences(0, printer);
+
+    suffixTrie.clear();
+    addSuffixes(0);
+
     printer.print("Normalizing tagger");
     printer.incProgress();
     hmm.normalize(smoothingFactor);
 
+    if (order == 3)
+    {
+        hmm3.normalize(smoothingFactor);
+    }
+
+    return true;
+}
+
+bool Engine::addSentences(const std::string& path, const std::string& parserName)
+{
+    if (hmm.numHiddenStates() == 0)
+    {
+        spdlog::error("Tagger should be trained or loaded before adding sentences");
+        return false;
+    }
+
+    if (hmm.getStorage() != Storage::Float32)
+    {
+        spdlog::error("Quantized tagger has no counts to add sentences to");
+        return false;
+    }
+
+    const size_t first = sentences.size();
+
+    if (!parse(path, parserName))
+    {
+        return false;
+    }
+
+    Printer printer("Adding sentences to tagger", sentences.size() - first + 1);
+
+    // Parsed sentences may bring new words and tags
+    tagStream.reset();
+    hmm.grow(tagsCollection.tagsSize(), wordsCollection.wordsSize());
+    if (taggerOrder == 3)
+    {
+        hmm3.grow(tagsCollection.tagsSize());
+    }
+
+    countTaggerSentences(first, printer);
+    addSuffixes(first);
+
+    printer.print("Renormalizing tagger");
+    printer.incProgress();
+    hmm.renormalize();
+
+    if (taggerOrder == 3)
+    {
+        hmm3.renormalize();
+    }
+
+    return true;
+}
+
+bool Engine::quantizeTagger(Storage storage)
+{
+    if (hmm.numHiddenStates() == 0)
+    {
+        spdlog::error("Tagger should be trained or loaded before quantization");
+        return false;
+    }
+
+    const size_t before = hmm.bytes();
+    if (!hmm.quantize(storage))
+    {
+        return false;
+    }
+
+    tagStream.reset();
+
+    spdlog::info("Tagger log probabilities take {} bytes instead of {}", hmm.bytes(), before);
+
+    return true;
+}
+
+void Engine::lexiconTags(const Words& sentence, std::vector<Tags>& allowed) const
+{
+    allowed.resize(sentence.size());
+    for (size_t i = 0; i < sentence.size(); ++i)
+    {
+        allowed[i].clear();
+        if (sentence[i] == wordsCollection.unknownWord())
+        {
+            continue;
+        }
+
+        const TagSet& tags = wordsCollection.findTagsForWord(sentence[i]);
+        allowed[i].assign(tags.begin(), tags.end());
+        std::sort(allowed[i].begin(), allowed[i].end());
+    }
+}
+
+std::vector<Tags> Engine::lexiconTags(const Words& sentence) const
+{
+    std::vector<Tags> allowed;
+    lexiconTags(sentence, allowed);
+    return allowed;
+}
+
+bool Engine::decode(const Words& sentence, const std::vector<Tags>* allowed, const EmissionOverrides* overrides, size_t beamWidth, Tags& result) const
+{
+    const TagId serviceTag = tagsCollection.serviceTag();
+
+    // Bigram Viterbi reuses buffers of the calling thread
+    if (taggerOrder != 3 && beamWidth == 0)
+    {
+        thread_local HMM<float, TagId, WordId>::DecodeWorkspace workspace;
+        return hmm.predict(serviceTag, sentence, allowed, overrides, workspace, result);
+    }
+
+    if (!allowed)
+    {
+        result = taggerOrder == 3 ? hmm3.predict(hmm, serviceTag, sentence, beamWidth) : hmm.predictBeam(serviceTag, sentence, beamWidth);
+    }
+    else if (taggerOrder == 3)
+    {
+        result = hmm3.predict(hmm, serviceTag, sentence, *allowed, beamWidth, overrides);
+    }
+    else
+    {
+        result = hmm.predictBeam(serviceTag, sentence, *allowed, beamWidth, overrides);
+    }
+
+    return result.size() == sentence.size();
+}
+
+bool Engine::tag(const Words& sentence, Tags& result, bool useLexicon, size_t beamWidth) const
+{
+    if (!useLexicon)
+    {
+        return decode(sentence, nullptr, nullptr, beamWidth, result);
+    }
+
+    thread_local std::vector<Tags> allowed;
+    lexiconTags(sentence, allowed);
+
+    return decode(sentence, &allowed, nullptr, beamWidth, result);
+}
+
+std::optional<Tags> Engine::tag(const Words& sentence, bool useLexicon, size_t beamWidth) const
+{
+    Tags result;
+    if (!tag(sentence, result, useLexicon, beamWidth))
+    {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+std::optional<Tags> Engine::tagForms(const Strings& forms, bool useLexicon, size_t beamWidth) const
+{
+    spdlog::debug("Tagging forms");
+
+    Strings lowered(forms);
+    Words sentence(forms.size());
+    for (size_t i = 0; i < forms.size(); ++i)
+    {
+        toLower(lowered[i]);
+        sentence[i] = wordsCollection.word2index(lowered[i]);
+    }
+
+    std::vector<Tags> allowed = useLexicon ? lexiconTags(sentence) : std::vector<Tags>(sentence.size());
+    EmissionOverrides overrides(sentence.size());
+
+    // Unknown words are restricted to the tags guessed by their suffixes
+    for (size_t i = 0; i < sentence.size(); ++i)
+    {
+        if (sentence[i] != wordsCollection.unknownWord())
+        {
+            continue;
+        }
+
+        const auto estimate = suffixTrie.estimate(lowered[i]);
+        if (estimate.states.empty())
+        {
+            continue;
+        }
+
+        allowed[i] = estimate.states;
+        overrides[i].assign(hmm.numHiddenStates(), -std::numeric_limits<float>::infinity());
+        for (size_t j = 0; j < estimate.states.size(); ++j)
+        {
+            overrides[i][estimate.states[j]] = estimate.scores[j];
+        }
+    }
+
+    Tags result;
+    if (!decode(sentence, &allowed, &overrides, beamWidth, result))
+    {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+std::optional<TagPosteriors> Engine::tagPosteriors(const Words& sentence, size_t k, bool useLexicon) const
+{
+    spdlog::debug("Tag posteriors");
+
+    if (k == 0)
+    {
+        spdlog::error("Number of posteriors per word should be positive");
+        return std::nullopt;
+    }
+
+    const TagId serviceTag = tagsCollection.serviceTag();
+
+    if (!useLexicon)
+    {
+        return hmm.posteriors(serviceTag, sentence, k);
+    }
+
+    return hmm.posteriors(serviceTag, sentence, lexiconTags(sentence), k);
+}
+
+std::optional<TagSequences> Engine::tagNBest(const Words& sentence, size_t k, bool useLexicon) const
+{
+    if (k == 0)
+    {
+        spdlog::error("Number of tag sequences should be positive");
+        return std::nullopt;
+    }
+
+    const TagId serviceTag = tagsCollection.serviceTag();
+
+    if (!useLexicon)
+    {
+        return hmm.predictNBest(serviceTag, sentence, k);
+    }
+
+    return hmm.predictNBest(serviceTag, sentence, lexiconTags(sentence), k);
+}
+
+bool Engine::pushWord(WordId word, Tags& decided, bool useLexicon)
+{
+    if (hmm.numHiddenStates() == 0)
+    {
+        spdlog::error("Tagger should be trained or loaded before streaming");
+        return false;
+    }
+
+    if (!tagStream)
+    {
+        tagStream.emplace(hmm, tagsCollection.serviceTag(), streamLatency);
+    }
+
+    streamAllowed.clear();
+    if (useLexicon && word != wordsCollection.unknownWord())
+    {
+        const TagSet& tags = wordsCollection.findTagsForWord(word);
+        streamAllowed.assign(tags.begin(), tags.end());
+        std::sort(streamAllowed.begin(), streamAllowed.end());
+    }
+
+    tagStream->push(word, &streamAllowed, decided);
+
     return true;
 }
 
-std::optional<Tags> Engine::tag(const Words& sentence) const
+bool Engine::flushWords(Tags& decided)
 {
-    spdlog::debug("Tagging");
+    if (tagStream)
+    {
+        tagStream->flush(decided);
+    }
 
-    return hmm.predict(tagsCollection.serviceTag(), sentence);
+    return true;
+}
+
+bool Engine::tagBatch(const Words& words, const std::vector<size_t>& offsets, Tags& result, bool useLexicon, size_t beamWidth) const
+{
+    spdlog::debug("Tagging batch of {} sentences", offsets.empty() ? 0 : offsets.size() - 1);
+
+    if (offsets.empty() || offsets.back() != words.size() || !std::is_sorted(offsets.begin(), offsets.end()))
+    {
+        spdlog::error("Wrong sentence offsets for {} words", words.size());
+        return false;
+    }
+
+    result.resize(words.size());
+
+    std::atomic<bool> success = true;
+
+    threadPool.parallelFor(offsets.size() - 1, [&](size_t begin, size_t end, size_t)
+    {
+        // Buffers of the worker thread are kept between batches
+        thread_local Words sentence;
+        thread_local Tags tags;
+        for (size_t i = begin; i < end && success; ++i)
+        {
+            sentence.assign(words.begin() + offsets[i], words.begin() + offsets[i + 1]);
+
+            if (!tag(sentence, tags, useLexicon, beamWidth))
+            {
+                spdlog::error("Failed to tag sentence {}", i);
+                success = false;
+                return;
+            }
+
+            std::copy(tags.begin(), tags.end(), result.begin() + offsets[i]);
+        }
+    });
+
+    return success;
 }
 
-bool Engine::trainTreeBuilder(double smoothingFactor)
+bool Engine::trainTreeBuilder(double smoothingFactor, bool relationStatistics)
 {
     Printer printer("Training tree builder", sentences.size() + 1);
 
-    drStat.resize(depRelsCollection.depRelsSize(), tagsCollection.tagsSize());
+    drStat.resize(depRelsCollection.depRelsSize(), tagsCollection.tagsSize(), relationStatistics);
 
-    for (const auto& sentence: sentences)
+    // Every worker counts into its own shard, shards are merged in worker order
+    std::vector<DepRelStatistics::Counts> counts(threadPool.size(), DepRelStatistics::Counts(tagsCollection.tagsSize()));
+    std::mutex printerMutex;
+
+    threadPool.parallelFor(sentences.size(), [&](size_t begin, size_t end, size_t worker)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            drStat.countSentence(depRelsCollection, sentences[i], counts[worker]);
+        }
+
+        std::lock_guard<std::mutex> lock(printerMutex);
+        printer.incProgress(end - begin);
+    });
+
+    for (const auto& shard: counts)
     {
-        printer.incProgress();
-        drStat.processSentence(tagsCollection, depRelsCollection, sentence);
+        drStat.merge(shard);
     }
 
     printer.print("Normalizing tree builder");
     printer.incProgress();
     drStat.normalize(smoothingFactor);
 
-    drStat.printStatistics(tagsCollection, depRelsCollection);
+    if (relationStatistics)
+    {
+        drStat.printStatistics(tagsCollection, depRelsCollection);
+    }
 
     return true;
 }
@@ -481,15 +940,142 @@ bool Engine::loadTreeBuilder(const std::string& fileName)
         return false;
     }
 
+    // Statistics are indexed by tags and relations of the collections, they should be the ones trained with
+    if (tagsSize != tagsCollection.tagsSize() || depRelsSize != depRelsCollection.depRelsSize())
+    {
+        spdlog::error("Tree builder was trained with {} tags and {} relations, collections have {} and {}",
+            tagsSize, depRelsSize, tagsCollection.tagsSize(), depRelsCollection.depRelsSize());
+        return false;
+    }
+
     drStat.resize(depRelsCollection.depRelsSize(), tagsCollection.tagsSize());
 
-    return drStat.loadBinary(zfile);
+    if (!drStat.loadBinary(zfile)
+        || drStat.numTags() != tagsCollection.tagsSize()
+        || drStat.numDepRels() != depRelsCollection.depRelsSize())
+    {
+        spdlog::error("Failed to load tree builder statistics");
+        // Nothing half loaded is left to read out of bounds
+        drStat.resize(depRelsCollection.depRelsSize(), tagsCollection.tagsSize());
+        return false;
+    }
+
+    return true;
+}
+
+void Engine::setTreeSolver(TreeSolver solver)
+{
+    drStat.setSolver(solver);
+}
+
+bool Engine::enableTreeTrace(const std::string& directory, size_t sampleEvery)
+{
+    if (sampleEvery == 0)
+    {
+        spdlog::error("Trace sampling should be positive");
+        return false;
+    }
+
+    disableTreeTrace();
+    treeTrace = std::make_unique<TraceSink>(directory, sampleEvery);
+    drStat.setTraceSink(treeTrace.get());
+    return true;
 }
 
-std::optional<DepRelStatistics::Edges> Engine::buildDependencyTree(const std::vector<TagId>& tags)
+void Engine::disableTreeTrace()
+{
+    drStat.setTraceSink(nullptr);
+    treeTrace.reset();
+}
+
+std::optional<DepRelStatistics::Edges> Engine::buildDependencyTree(const std::vector<TagId>& tags, std::optional<TreeSolver> solver)
 {
     spdlog::info("Build dependency tree");
-    return drStat.extractGraph(tagsCollection, depRelsCollection, tags);
+    return drStat.extractGraph(tagsCollection, depRelsCollection, tags, true, solver);
+}
+
+bool Engine::buildDependencyTrees(const Tags& tags, const std::vector<size_t>& offsets, DepRelStatistics::Edges& result, std::optional<TreeSolver> solver) const
+{
+    spdlog::debug("Building dependency trees for batch of {} sentences", offsets.empty() ? 0 : offsets.size() - 1);
+
+    if (offsets.empty() || offsets.back() != tags.size() || !std::is_sorted(offsets.begin(), offsets.end()))
+    {
+        spdlog::error("Wrong sentence offsets for {} tags", tags.size());
+        return false;
+    }
+
+    result.resize(tags.size());
+
+    std::atomic<bool> success = true;
+
+    threadPool.parallelFor(offsets.size() - 1, [&](size_t begin, size_t end, size_t)
+    {
+        thread_local Tags sentence;
+        DepRelStatistics::Workspace& ws = DepRelStatistics::threadWorkspace();
+        for (size_t i = begin; i < end && success; ++i)
+        {
+            sentence.assign(tags.begin() + offsets[i], tags.begin() + offsets[i + 1]);
+
+            if (!drStat.extractGraph(depRelsCollection, sentence, ws, result.data() + offsets[i], solver))
+            {
+                spdlog::error("Failed to build dependency tree of sentence {}", i);
+                success = false;
+                return;
+            }
+        }
+    });
+
+    return success;
+}
+
+std::optional<DepRelStatistics::ScoredTrees> Engine::buildDependencyTreeNBest(const std::vector<TagId>& tags, size_t k) const
+{
+    spdlog::debug("Build {} best dependency trees", k);
+
+    if (k == 0)
+    {
+        spdlog::error("Number of dependency trees should be positive");
+        return std::nullopt;
+    }
+
+    auto trees = drStat.extractKBest(depRelsCollection, tags, k, DepRelStatistics::threadWorkspace());
+    if (trees.empty())
+    {
+        spdlog::error("Failed to build dependency trees");
+        return std::nullopt;
+    }
+
+    return trees;
+}
+
+bool Engine::analyze(const Words& sentence, Analysis& result, bool useLexicon, size_t beamWidth, std::optional<TreeSolver> solver) const
+{
+    spdlog::debug("Analyzing sentence of {} words", sentence.size());
+
+    if (!tag(sentence, result.tags, useLexicon, beamWidth))
+    {
+        return false;
+    }
+
+    result.edges.resize(result.tags.size());
+    if (!drStat.extractGraph(depRelsCollection, result.tags, DepRelStatistics::threadWorkspace(), result.edges.data(), solver))
+    {
+        spdlog::error("Failed to build dependency tree");
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<Analysis> Engine::analyze(const Words& sentence, bool useLexicon, size_t beamWidth, std::optional<TreeSolver> solver) const
+{
+    Analysis result;
+    if (!analyze(sentence, result, useLexicon, beamWidth, solver))
+    {
+        return std::nullopt;
+    }
+
+    return result;
 }
 
 DepRelsCollection& Engine::getDepRelsCollection()
@@ -4,8 +4,12 @@
 #include <vector>
 #include <unordered_map>
 #include <optional>
+#include <memory>
 
 #include "../ML/HMM.h"
+#include "../ML/TrigramHMM.h"
+#include "../ML/StreamingViterbi.h"
+#include "../ML/SuffixTrie.h"
 #include "../ML/DepRelStatistics.h"
 #include "../Collections/WordsCollection.h"
 #include "../Collections/TagsCollection.h"
@@ -13,10 +17,23 @@
 #include "../Parsers/Parser.h"
 #include "Sentence.h"
 #include "Printer.h"
+#include "ThreadPool.h"
 
 typedef std::vector<std::string> Strings;
 typedef std::vector<TagId> Tags;
 typedef std::vector<WordId> Words;
+typedef HMM<float, TagId, WordId>::Posterior TagPosterior;
+typedef std::vector<TagPosterior> TagPosteriors;
+typedef HMM<float, TagId, WordId>::ScoredStates TagSequence;
+typedef std::vector<TagSequence> TagSequences;
+typedef HMM<float, TagId, WordId>::EmissionOverrides EmissionOverrides;
+
+// Tags of a sentence and its dependency tree, edges sorted by dependent
+struct Analysis
+{
+    Tags tags;
+    DepRelStatistics::Edges edges;
+};
 
 class Engine
 {
@@ -29,15 +46,42 @@ class Engine
     DepRelsCollection depRelsCollection;
 
     HMM<float, TagId, WordId> hmm;
+    TrigramHMM<float, TagId, WordId> hmm3;
+    uint8_t taggerOrder = 2;
+    SuffixTrie<float, TagId> suffixTrie;
     DepRelStatistics drStat;
+    std::unique_ptr<TraceSink> treeTrace;
+
+    // Created by the first pushed word, dropped whenever the tagger changes
+    std::optional<StreamingViterbi<float, TagId, WordId>> tagStream;
+    Tags streamAllowed;
 
     Sentence unkWordOnly;
 
+    mutable ThreadPool threadPool;
+
     bool parseDirectory(const std::string& path, const std::string& parserName);
 
     bool parseFile(const std::string& path, const std::string& parserName);
 
-    void trainHMMOnSentence(const Sentence& sentence);
+    void trainHMMOnSentence(const Sentence& sentence, HMM<float, TagId, WordId>::Counts& counts) const;
+
+    void trainTrigramHMMOnSentence(const Sentence& sentence, TrigramHMM<float, TagId, WordId>::Counts& counts) const;
+
+    // Sorted tags of every word from the lexicon, empty for unknown words
+    void lexiconTags(const Words& sentence, std::vector<Tags>& allowed) const;
+
+    std::vector<Tags> lexiconTags(const Words& sentence) const;
+
+    // Words seen at most that many times in training are used for suffixes
+    static constexpr size_t rareWordFrequency = 10;
+
+    void addSuffixes(size_t first);
+
+    bool decode(const Words& sentence, const std::vector<Tags>* allowed, const EmissionOverrides* overrides, size_t beamWidth, Tags& result) const;
+
+    // Counts sentences starting from first into the tagger
+    void countTaggerSentences(size_t first, Printer& printer);
 
 public:
     static Engine& singleton();
@@ -54,9 +98,26 @@ public:
 
     void clearSentences();
 
-    bool trainTagger(float smoothingFactor);
+    // Order 2 is the bigram HMM, order 3 adds second order transitions on top of it
+    bool trainTagger(float smoothingFactor, size_t order = 2);
+
+    // Parses more sentences and adds them to the trained tagger, only changed rows are renormalized
+    bool addSentences(const std::string& path, const std::string& parserName);
+
+    // Stores bigram log probabilities as fp16 or int8 for deployment, the tagger can not be extended afterwards
+    bool quantizeTagger(Storage storage);
+
+    // Sentences are counted in parallel, relation statistics are written to dr.csv if asked
+    bool trainTreeBuilder(double smoothingFactor, bool relationStatistics = false);
 
-    bool trainTreeBuilder(double smoothingFactor);
+    void setTreeSolver(TreeSolver solver);
+
+    // Every sampleEvery-th tree is traced as dot files into directory by a background thread.
+    // Should not be called while trees are being built.
+    bool enableTreeTrace(const std::string& directory, size_t sampleEvery);
+
+    // Waits until traced trees are written
+    void disableTreeTrace();
 
     bool parse(const std::string& path, const std::string& parserName);
 
@@ -68,7 +129,33 @@ public:
 
     bool loadCollections(const std::string& fileName);
 
-    std::optional<Tags> tag(const Words& sentence) const;
+    std::optional<Tags> tag(const Words& sentence, bool useLexicon = false, size_t beamWidth = 0) const;
+
+    // Same as above writing into result, bigram Viterbi does not allocate once buffers of the thread have grown
+    bool tag(const Words& sentence, Tags& result, bool useLexicon = false, size_t beamWidth = 0) const;
+
+    // Unknown words are tagged by the suffix model, forms are lowercased before lookup
+    std::optional<Tags> tagForms(const Strings& forms, bool useLexicon = false, size_t beamWidth = 0) const;
+
+    // k most probable tags with their posterior probabilities for every word, k entries per word.
+    // Posteriors come from the bigram HMM whatever the tagger order is.
+    std::optional<TagPosteriors> tagPosteriors(const Words& sentence, size_t k, bool useLexicon = false) const;
+
+    // k most probable tag sequences with their log probabilities, best first, from the bigram HMM
+    std::optional<TagSequences> tagNBest(const Words& sentence, size_t k, bool useLexicon = false) const;
+
+    // Streaming tagging by the bigram HMM for input without reliable sentence boundaries, not thread safe.
+    // Tags are appended to decided as soon as they can not change, at most streamLatency words are pending
+    // and at most streamLatency tags are appended by a call.
+    bool pushWord(WordId word, Tags& decided, bool useLexicon = false);
+
+    // Ends the stream as a sentence end and appends the remaining tags
+    bool flushWords(Tags& decided);
+
+    static constexpr size_t streamLatency = StreamingViterbi<float, TagId, WordId>::defaultMaxLatency;
+
+    // Sentence i is words[offsets[i], offsets[i + 1]), tags are written at the same places of result
+    bool tagBatch(const Words& words, const std::vector<size_t>& offsets, Tags& result, bool useLexicon = false, size_t beamWidth = 0) const;
 
     bool saveTagger(const std::string& fileName) const;
 
@@ -78,7 +165,21 @@ public:
 
     bool loadTreeBuilder(const std::string& fileName);
 
-    std::optional<DepRelStatistics::Edges> buildDependencyTree(const std::vector<TagId>& tags);
+    // Solver of the call, the one set by setTreeSolver if none
+    std::optional<DepRelStatistics::Edges> buildDependencyTree(const std::vector<TagId>& tags, std::optional<TreeSolver> solver = std::nullopt);
+
+    // Sentence i is tags[offsets[i], offsets[i + 1]), its edges are written at the same places of result.
+    // Sentences are built on the thread pool, every worker reuses its graph workspace.
+    bool buildDependencyTrees(const Tags& tags, const std::vector<size_t>& offsets, DepRelStatistics::Edges& result, std::optional<TreeSolver> solver = std::nullopt) const;
+
+    // k best trees with their scores for rerankers, best first, fewer if there are not that many
+    std::optional<DepRelStatistics::ScoredTrees> buildDependencyTreeNBest(const std::vector<TagId>& tags, size_t k) const;
+
+    // Tagging and tree building in one call, the tree is built on the tags as they come out of the tagger
+    std::optional<Analysis> analyze(const Words& sentence, bool useLexicon = false, size_t beamWidth = 0, std::optional<TreeSolver> solver = std::nullopt) const;
+
+    // Same as above writing into result, nothing is allocated once buffers of the thread and result have grown
+    bool analyze(const Words& sentence, Analysis& result, bool useLexicon = false, size_t beamWidth = 0, std::optional<TreeSolver> solver = std::nullopt) const;
 
     WordsCollection& getWordsCollection();
     TagsCollection& getTagsCollection();
@@ -0,0 +1,149 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+ThreadPool::ThreadPool(size_t numThreads)
+{
+    numThreads = std::max<size_t>(numThreads, 1);
+
+    spdlog::debug("Starting thread pool with {} threads", numThreads);
+
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return threads.size();
+}
+
+bool ThreadPool::pop(size_t worker, Task& task)
+{
+    Queue& queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --queued;
+
+    return true;
+}
+
+bool ThreadPool::steal(size_t worker, Task& task)
+{
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        Queue& queue = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty())
+        {
+            continue;
+        }
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        --queued;
+
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::run(size_t worker)
+{
+    while (true)
+    {
+        Task task;
+        if (pop(worker, task) || steal(worker, task))
+        {
+            task(worker);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Queue& queue = *queues[nextQueue];
+        nextQueue = (nextQueue + 1) % queues.size();
+
+        std::lock_guard<std::mutex> queueLock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        ++queued;
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t, size_t, size_t)>& f)
+{
+    if (n == 0)
+    {
+        return;
+    }
+
+    // Several chunks per thread leave something to steal when chunks are uneven
+    const size_t chunks = std::min(n, 8 * size());
+    const size_t chunkSize = (n + chunks - 1) / chunks;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    size_t remaining = (n + chunkSize - 1) / chunkSize;
+
+    for (size_t begin = 0; begin < n; begin += chunkSize)
+    {
+        const size_t end = std::min(n, begin + chunkSize);
+        submit([&, begin, end](size_t worker)
+        {
+            f(begin, end, worker);
+
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--remaining == 0)
+            {
+                doneCv.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCv.wait(lock, [&] { return remaining == 0; });
+}
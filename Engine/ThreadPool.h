@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+// Thread pool where every worker has its own queue and steals from others when it is empty
+class ThreadPool
+{
+public:
+    // Task receives index of the worker running it
+    typedef std::function<void(size_t)> Task;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<size_t> queued = 0;
+    bool stopping = false;
+
+    size_t nextQueue = 0;
+
+    bool pop(size_t worker, Task& task);
+    bool steal(size_t worker, Task& task);
+
+    void run(size_t worker);
+
+public:
+    ThreadPool(size_t numThreads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    size_t size() const;
+
+    void submit(Task task);
+
+    // Calls f(begin, end, worker) for chunks of [0, n) and waits for all of them
+    void parallelFor(size_t n, const std::function<void(size_t, size_t, size_t)>& f);
+};
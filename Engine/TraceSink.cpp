@@ -0,0 +1,124 @@
+#include "TraceSink.h"
+
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+
+#include "spdlog/spdlog.h"
+
+TraceSink::TraceSink(const std::string& directory, size_t sampleEvery, size_t capacity)
+    : directory(directory)
+    , sampleEvery(std::max<size_t>(sampleEvery, 1))
+    , ring(std::max<size_t>(capacity, 1))
+{
+    spdlog::debug("Tracing every {} trace into {}", this->sampleEvery, directory);
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+
+    writer = std::thread(&TraceSink::run, this);
+}
+
+TraceSink::~TraceSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    writer.join();
+}
+
+std::optional<uint64_t> TraceSink::sample()
+{
+    const uint64_t trace = traces.fetch_add(1, std::memory_order_relaxed);
+    return trace % sampleEvery == 0 ? std::make_optional(trace) : std::nullopt;
+}
+
+void TraceSink::record(uint64_t trace, const std::string& name, std::string&& text)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (pending == ring.size())
+        {
+            head = (head + 1) % ring.size();
+            --pending;
+            ++_dropped;
+        }
+
+        Record& r = ring[(head + pending) % ring.size()];
+        r.trace = trace;
+        r.name = name;
+        r.text = std::move(text);
+        ++pending;
+    }
+    cv.notify_one();
+}
+
+void TraceSink::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return pending == 0 && !writing; });
+}
+
+size_t TraceSink::dropped()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return _dropped;
+}
+
+size_t TraceSink::written()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return _written;
+}
+
+void TraceSink::write(const Record& record) const
+{
+    const auto path = std::filesystem::path(directory) / (std::to_string(record.trace) + "-" + record.name + ".dot");
+
+    std::ofstream stream(path);
+    if (!stream)
+    {
+        spdlog::error("Could not open trace file {}", path.string());
+        return;
+    }
+    stream << record.text;
+}
+
+void TraceSink::run()
+{
+    Record record;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        cv.wait(lock, [this] { return stopping || pending != 0; });
+
+        // Everything recorded before stopping is still written
+        if (pending == 0)
+        {
+            break;
+        }
+
+        std::swap(record, ring[head]);
+        head = (head + 1) % ring.size();
+        --pending;
+        writing = true;
+
+        lock.unlock();
+        write(record);
+        lock.lock();
+
+        writing = false;
+        ++_written;
+        if (pending == 0)
+        {
+            idle.notify_all();
+        }
+    }
+
+    idle.notify_all();
+}
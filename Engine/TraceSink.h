@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <optional>
+
+// Opt-in diagnostics: every sampleEvery-th trace is kept, its records go into a ring buffer
+// and a background thread writes them to directory as <trace>-<name>.dot.
+// When the ring is full the oldest record is dropped, callers never wait for the disk.
+class TraceSink
+{
+    struct Record
+    {
+        uint64_t trace = 0;
+        std::string name;
+        std::string text;
+    };
+
+    const std::string directory;
+    const size_t sampleEvery;
+
+    std::atomic<uint64_t> traces = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable idle;
+    std::vector<Record> ring;
+    size_t head = 0;
+    size_t pending = 0;
+    bool writing = false;
+    bool stopping = false;
+    size_t _dropped = 0;
+    size_t _written = 0;
+
+    std::thread writer;
+
+    void run();
+
+    void write(const Record& record) const;
+
+public:
+    TraceSink(const std::string& directory, size_t sampleEvery = 1, size_t capacity = 64);
+    ~TraceSink();
+
+    TraceSink(const TraceSink&) = delete;
+    TraceSink& operator=(const TraceSink&) = delete;
+
+    // Id of a new trace if it is sampled
+    std::optional<uint64_t> sample();
+
+    void record(uint64_t trace, const std::string& name, std::string&& text);
+
+    // Waits until every recorded trace is written
+    void flush();
+
+    size_t dropped();
+
+    size_t written();
+};
@@ -1,13 +1,59 @@
 #include "DepRelStatistics.h"
 
 #include <fstream>
+#include <sstream>
 #include <cmath>
+#include <algorithm>
+#include <limits>
 
 #include "spdlog/spdlog.h"
 
 #include "../Math/MSTD.h"
 
+void DepRelStatistics::resize(TagId depRelsNum, TagId tagsNum, bool relationStatistics)
+{
+    this->depRelsNum = depRelsNum;
+    this->tagsNum = tagsNum;
+
+    counts = Counts(tagsNum);
+    relations = std::vector<std::atomic<uint32_t>>(relationStatistics ? size_t(tagsNum) * depRelsNum : 0);
+    offsets.assign(size_t(tagsNum) + 1, 0);
+    keys.clear();
+    logProbs.clear();
+    logZ.assign(tagsNum, 0);
+    logSmoothing = 0;
+}
+
+bool DepRelStatistics::operator==(const DepRelStatistics& other) const
+{
+    return depRelsNum == other.depRelsNum
+        && tagsNum == other.tagsNum
+        && offsets == other.offsets
+        && keys == other.keys
+        && logProbs == other.logProbs
+        && logZ == other.logZ
+        && logSmoothing == other.logSmoothing;
+}
+
+float DepRelStatistics::logProb(TagId depRel, TagId src, TagId dest) const
+{
+    const Key k = key(depRel, src);
+    const auto first = keys.begin() + offsets[dest];
+    const auto last = keys.begin() + offsets[dest + 1];
+    const auto it = std::lower_bound(first, last, k);
+    if (it != last && *it == k)
+    {
+        return logProbs[it - keys.begin()];
+    }
+    return logSmoothing - logZ[dest];
+}
+
 void DepRelStatistics::processSentence(const TagsCollection& tc, const DepRelsCollection& drc, const Sentence& sentence)
+{
+    countSentence(drc, sentence, counts);
+}
+
+void DepRelStatistics::countSentence(const DepRelsCollection& drc, const Sentence& sentence, Counts& counts)
 {
     size_t zeroCount = 0;
     for (const auto& word: sentence.words)
@@ -31,25 +77,192 @@ void DepRelStatistics::processSentence(const TagsCollection& tc, const DepRelsCo
         }
         TagId src = word.depHead == 0 ? drc.depRelRoot(): sentence.words[word.depHead - 1].tags;
         TagId dest = word.tags;
-        ++stat.at(word.depRel, src, dest);
+        ++counts.rows[dest][key(word.depRel, src)];
 
-        (statistics[dest][word.depRel])++;
+        if (!relations.empty())
+        {
+            relations[size_t(dest) * depRelsNum + word.depRel].fetch_add(1, std::memory_order_relaxed);
+        }
     }
 }
 
+void DepRelStatistics::merge(const Counts& shard)
+{
+    for (TagId dest = 0; dest < tagsNum; ++dest)
+    {
+        auto& row = counts.rows[dest];
+        for (const auto& [k, c]: shard.rows[dest])
+        {
+            row[k] += c;
+        }
+    }
+}
+
+uint32_t DepRelStatistics::relationCount(TagId dest, TagId depRel) const
+{
+    return relations.empty() ? 0 : relations[size_t(dest) * depRelsNum + depRel].load(std::memory_order_relaxed);
+}
+
 void DepRelStatistics::normalize(float smoothingFactor)
 {
     spdlog::debug("Normalizing tree builder statistics {}", smoothingFactor);
-    stat.normalizeLog(smoothingFactor, 2);
+
+    // Every (depRel, srcTag) of a destination tag gets smoothingFactor
+    const double unseen = double(smoothingFactor) * depRelsNum * tagsNum;
+    logSmoothing = std::log(smoothingFactor);
+
+    keys.clear();
+    logProbs.clear();
+    offsets.assign(size_t(tagsNum) + 1, 0);
+
+    std::vector<std::pair<Key, uint32_t>> row;
+    for (TagId dest = 0; dest < tagsNum; ++dest)
+    {
+        row.assign(counts.rows[dest].begin(), counts.rows[dest].end());
+        std::sort(row.begin(), row.end());
+
+        uint64_t total = 0;
+        for (const auto& [k, c]: row)
+        {
+            total += c;
+        }
+        logZ[dest] = std::log(total + unseen);
+
+        for (const auto& [k, c]: row)
+        {
+            keys.push_back(k);
+            logProbs.push_back(std::log(c + smoothingFactor) - logZ[dest]);
+        }
+        offsets[dest + 1] = keys.size();
+
+        counts.rows[dest] = {};
+    }
+
+    spdlog::debug("Tree builder keeps {} triples, {} bytes", keys.size(), bytes());
 }
 
-std::optional<DepRelStatistics::Edges> DepRelStatistics::extractGraph(const TagsCollection& tc, const DepRelsCollection& drc, const std::vector<TagId>& tags)
+std::optional<DepRelStatistics::Edges> DepRelStatistics::extractGraph(const TagsCollection& tc, const DepRelsCollection& drc, const std::vector<TagId>& tags, bool bestLabelOnly, std::optional<TreeSolver> solver) const
 {
-    spdlog::debug("Extracting tree from graph for {} tags, {} labels, root {}", tags.size(), stat.sizeAt(0), drc.depRelRoot());
+    spdlog::debug("Extracting tree from graph for {} tags, {} labels, root {}", tags.size(), depRelsNum, drc.depRelRoot());
 
-    DepRelStatistics::G g(tags.size() + 1, stat.sizeAt(0));
+    const TreeSolver s = solver.value_or(this->solver);
+    return bestLabelOnly ? extractBestLabelGraph(drc, tags, s) : extractLabeledGraph(drc, tags, s);
+}
+
+std::optional<DepRelStatistics::Edges> DepRelStatistics::spanningTree(G& g, TreeSolver solver)
+{
+    if (solver == TreeSolver::Tarjan)
+    {
+        TarjanMST<G> tarjan(g);
+        return tarjan.getSpanningTree(0);
+    }
+
+    if (solver == TreeSolver::Projective)
+    {
+        ProjectiveDecoder<G> eisner(g);
+        return eisner.getSpanningTree(0);
+    }
+
+    ChuLiuEdmondsMST<G> chuLiuEdmonds(g);
+    return chuLiuEdmonds.getSpanningTree(0);
+}
 
-    for (TagId depRel = 0; depRel < stat.sizeAt(0); ++depRel)
+std::optional<DepRelStatistics::Edges> DepRelStatistics::spanningTree(Workspace& ws, TreeSolver solver)
+{
+    if (solver == TreeSolver::Tarjan)
+    {
+        return ws.tarjan.getSpanningTree(0);
+    }
+
+    if (solver == TreeSolver::Projective)
+    {
+        return ws.projective.getSpanningTree(0);
+    }
+
+    return spanningTree(ws.graph, solver);
+}
+
+std::optional<uint64_t> DepRelStatistics::sampleTrace() const
+{
+    return traceSink ? traceSink->sample() : std::nullopt;
+}
+
+void DepRelStatistics::record(uint64_t trace, const std::string& name, const Edges& edges) const
+{
+    std::ostringstream stream;
+    G::saveDot(stream, edges);
+    traceSink->record(trace, name, stream.str());
+}
+
+void DepRelStatistics::relabel(const Workspace& ws, Edges& edges)
+{
+    const size_t size = ws.graph.numVertices();
+    for (auto& e: edges)
+    {
+        e.label = ws.labels[e.src * size + e.dest];
+    }
+}
+
+bool DepRelStatistics::extractGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, Workspace& ws, Edge* result, std::optional<TreeSolver> solver) const
+{
+    fillBestLabelGraph(drc, tags, ws);
+
+    const auto trace = sampleTrace();
+    if (trace)
+    {
+        Edges edges = ws.graph.edges();
+        relabel(ws, edges);
+        record(*trace, "dr-src", edges);
+    }
+
+    auto p = spanningTree(ws, solver.value_or(this->solver));
+    if (!p || p->size() != tags.size())
+    {
+        return false;
+    }
+
+    relabel(ws, *p);
+    if (trace)
+    {
+        record(*trace, "dr", *p);
+    }
+
+    std::sort(p->begin(), p->end(), [](const Edge& a, const Edge& b) {return a.dest < b.dest;});
+    std::copy(p->begin(), p->end(), result);
+
+    return true;
+}
+
+DepRelStatistics::ScoredTrees DepRelStatistics::extractKBest(const DepRelsCollection& drc, const std::vector<TagId>& tags, size_t k, Workspace& ws) const
+{
+    fillBestLabelGraph(drc, tags, ws);
+
+    auto trees = ws.kBest.getSpanningTrees(0, k);
+    for (auto& tree: trees)
+    {
+        relabel(ws, tree.edges);
+    }
+
+    const auto trace = sampleTrace();
+    if (trace && !trees.empty())
+    {
+        Edges edges = ws.graph.edges();
+        relabel(ws, edges);
+        record(*trace, "dr-src", edges);
+        for (size_t i = 0; i < trees.size(); ++i)
+        {
+            record(*trace, "dr-" + std::to_string(i), trees[i].edges);
+        }
+    }
+
+    return trees;
+}
+
+std::optional<DepRelStatistics::Edges> DepRelStatistics::extractLabeledGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, TreeSolver solver) const
+{
+    DepRelStatistics::G g(tags.size() + 1, depRelsNum);
+
+    for (TagId depRel = 0; depRel < depRelsNum; ++depRel)
     {
         auto drTag = drc.getDependencyRelationTag(depRel);
         if (!drTag)
@@ -60,7 +273,7 @@ std::optional<DepRelStatistics::Edges> DepRelStatistics::extractGraph(const Tags
         {
             TagId src = tags[i1];
 
-            g.addEdge(0, i1 + 1, depRel, stat.at(depRel, 0, src) - std::log(tags.size() + i1));
+            g.addEdge(0, i1 + 1, depRel, logProb(depRel, 0, src) - std::log(tags.size() + i1));
 
             for (TagId i2 = 0; i2 < tags.size(); ++i2)
             {
@@ -76,23 +289,201 @@ std::optional<DepRelStatistics::Edges> DepRelStatistics::extractGraph(const Tags
 
                 float distancePenalty = std::log(std::fabs(float(i1) - float(i2)));
 
-                g.addEdge(i1 + 1, i2 + 1, depRel, stat.at(depRel, src, dest) - distancePenalty);
+                g.addEdge(i1 + 1, i2 + 1, depRel, logProb(depRel, src, dest) - distancePenalty);
             }
         }
     }
 
+    const auto trace = sampleTrace();
+    if (trace)
     {
-        std::ofstream s("dr-src.dot");
-        g.saveDot(s);
+        record(*trace, "dr-src", g.edges());
     }
 
-    ChuLiuEdmondsMST solver(g);
+    auto p = spanningTree(g, solver);
 
-    auto p = solver.getSpanningTree(0);
+    if (trace && p)
+    {
+        record(*trace, "dr", *p);
+    }
 
+    return p;
+}
+
+void DepRelStatistics::bestRelations(TagId src, TagId dest, const Workspace& ws, float* scores, TagId* labels) const
+{
+    const auto first = std::lower_bound(keys.begin() + offsets[dest], keys.begin() + offsets[dest + 1], key(0, src));
+    const auto last = std::upper_bound(first, keys.begin() + offsets[dest + 1], key(TagId(-1), src));
+
+    for (size_t dir = 0; dir < Workspace::DirectionsNum; ++dir)
+    {
+        scores[dir] = std::numeric_limits<float>::quiet_NaN();
+        labels[dir] = 0;
+    }
+
+    // Stored relations come by depRel, so the first one reaching the maximum wins
+    for (auto it = first; it != last; ++it)
+    {
+        const TagId depRel = TagId(*it);
+        const float lp = logProbs[it - keys.begin()];
+        for (size_t dir = 0; dir < Workspace::DirectionsNum; ++dir)
+        {
+            if ((ws.directions[depRel] >> dir & 1) && (std::isnan(scores[dir]) || lp > scores[dir]))
+            {
+                scores[dir] = lp;
+                labels[dir] = depRel;
+            }
+        }
+    }
+
+    // Relations not stored share the smoothed score, the first of them competes
+    const float unseen = logSmoothing - logZ[dest];
+    for (size_t dir = 0; dir < Workspace::DirectionsNum; ++dir)
+    {
+        auto it = first;
+        for (TagId depRel: ws.relations[dir])
+        {
+            while (it != last && TagId(*it) < depRel)
+            {
+                ++it;
+            }
+            if (it != last && TagId(*it) == depRel)
+            {
+                continue;
+            }
+
+            if (std::isnan(scores[dir]) || unseen > scores[dir] || (unseen == scores[dir] && depRel < labels[dir]))
+            {
+                scores[dir] = unseen;
+                labels[dir] = depRel;
+            }
+            break;
+        }
+    }
+}
+
+void DepRelStatistics::fillBestLabelGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, Workspace& ws) const
+{
+    const size_t n = tags.size();
+    const size_t size = n + 1;
+
+    ws.graph.reset(size, 1);
+    ws.labels.assign(size * size, 0);
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    ws.directions.assign(depRelsNum, 0);
+    for (auto& r: ws.relations)
+    {
+        r.clear();
+    }
+    for (TagId depRel = 0; depRel < depRelsNum; ++depRel)
+    {
+        auto drTag = drc.getDependencyRelationTag(depRel);
+        if (!drTag)
+        {
+            continue;
+        }
+        const size_t dir = drTag->headBefore ? Workspace::HeadBefore : Workspace::HeadAfter;
+        ws.directions[depRel] = (1 << dir) | (1 << Workspace::AnyDirection);
+        ws.relations[dir].push_back(depRel);
+        ws.relations[Workspace::AnyDirection].push_back(depRel);
+    }
+
+    // Scores depend on tags only, so every distinct pair is looked up once
+    ws.distinct.assign(tags.begin(), tags.end());
+    std::sort(ws.distinct.begin(), ws.distinct.end());
+    ws.distinct.erase(std::unique(ws.distinct.begin(), ws.distinct.end()), ws.distinct.end());
+
+    const size_t u = ws.distinct.size();
+    ws.positions.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        ws.positions[i] = std::lower_bound(ws.distinct.begin(), ws.distinct.end(), tags[i]) - ws.distinct.begin();
+    }
+
+    ws.pairScores.resize(u * u * 2);
+    ws.pairLabels.resize(u * u * 2);
+    ws.rootScores.resize(u);
+    ws.rootLabels.resize(u);
+
+    float scores[Workspace::DirectionsNum];
+    TagId labels[Workspace::DirectionsNum];
+    for (size_t d = 0; d < u; ++d)
+    {
+        for (size_t s = 0; s < u; ++s)
+        {
+            bestRelations(ws.distinct[s], ws.distinct[d], ws, scores, labels);
+            for (size_t dir = 0; dir < 2; ++dir)
+            {
+                ws.pairScores[(d * u + s) * 2 + dir] = scores[dir];
+                ws.pairLabels[(d * u + s) * 2 + dir] = labels[dir];
+            }
+        }
+
+        bestRelations(0, ws.distinct[d], ws, scores, labels);
+        ws.rootScores[d] = scores[Workspace::AnyDirection];
+        ws.rootLabels[d] = labels[Workspace::AnyDirection];
+    }
+
+    ws.logDistances.resize(2 * n - 1);
+    ws.logDistances[n - 1] = std::numeric_limits<float>::quiet_NaN();
+    for (size_t k = 1; k < n; ++k)
     {
-        std::ofstream s("dr.dot");
-        g.saveDot(s);
+        ws.logDistances[n - 1 + k] = ws.logDistances[n - 1 - k] = std::log(float(k));
+    }
+
+    // Heads of a dependent are contiguous in the graph, missing arcs stay NaN
+    ws.column.resize(n);
+    for (size_t i2 = 0; i2 < n; ++i2)
+    {
+        const size_t d = ws.positions[i2];
+        const float* pairs = ws.pairScores.data() + d * u * 2;
+        const TagId* pairLabels = ws.pairLabels.data() + d * u * 2;
+
+        for (size_t i1 = 0; i1 < n; ++i1)
+        {
+            const size_t pair = ws.positions[i1] * 2 + (i1 < i2);
+            ws.column[i1] = pairs[pair];
+            ws.labels[(i1 + 1) * size + i2 + 1] = pairLabels[pair];
+        }
+
+        const float* distances = ws.logDistances.data() + n - 1 - i2;
+        float* weights = &ws.graph.weight(1, i2 + 1, 0);
+        for (size_t i1 = 0; i1 < n; ++i1)
+        {
+            weights[i1] = ws.column[i1] - distances[i1];
+        }
+
+        ws.graph.weight(0, i2 + 1, 0) = ws.rootScores[d] - std::log(tags.size() + i2);
+        ws.labels[i2 + 1] = ws.rootLabels[d];
+    }
+}
+
+std::optional<DepRelStatistics::Edges> DepRelStatistics::extractBestLabelGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, TreeSolver solver) const
+{
+    Workspace& ws = threadWorkspace();
+    fillBestLabelGraph(drc, tags, ws);
+
+    const auto trace = sampleTrace();
+    if (trace)
+    {
+        Edges edges = ws.graph.edges();
+        relabel(ws, edges);
+        record(*trace, "dr-src", edges);
+    }
+
+    auto p = spanningTree(ws, solver);
+    if (p)
+    {
+        relabel(ws, *p);
+        if (trace)
+        {
+            record(*trace, "dr", *p);
+        }
     }
 
     return p;
@@ -100,18 +491,83 @@ std::optional<DepRelStatistics::Edges> DepRelStatistics::extractGraph(const Tags
 
 void DepRelStatistics::saveBinary(ZLibFile& zfile) const
 {
-    stat.saveBinary(zfile);
+    zfile.write(depRelsNum);
+    zfile.write(tagsNum);
+    zfile.write(logSmoothing);
+    zfile.write(offsets);
+    zfile.write(keys);
+    zfile.write(logProbs);
+    zfile.write(logZ);
 }
 
 bool DepRelStatistics::loadBinary(ZLibFile& zfile)
 {
-    return stat.loadBinary(zfile);
+    if (!zfile.read(depRelsNum)
+        || !zfile.read(tagsNum)
+        || !zfile.read(logSmoothing)
+        || !zfile.read(offsets)
+        || !zfile.read(keys)
+        || !zfile.read(logProbs)
+        || !zfile.read(logZ))
+    {
+        return false;
+    }
+
+    counts = Counts(tagsNum);
+    relations.clear();
+
+    if (offsets.size() != size_t(tagsNum) + 1
+        || offsets.front() != 0
+        || !std::is_sorted(offsets.begin(), offsets.end())
+        || offsets.back() != keys.size()
+        || logProbs.size() != keys.size()
+        || logZ.size() != tagsNum)
+    {
+        spdlog::error("Tree builder rows do not match {} tags", tagsNum);
+        return false;
+    }
+
+    // Rows are binary searched, so keys should be in range and strictly increasing within every row
+    for (TagId dest = 0; dest < tagsNum; ++dest)
+    {
+        for (size_t i = offsets[dest]; i < offsets[dest + 1]; ++i)
+        {
+            const TagId depRel = TagId(keys[i]);
+            const TagId src = TagId(keys[i] >> (8 * sizeof(TagId)));
+            if (depRel >= depRelsNum || src >= tagsNum || (i != offsets[dest] && keys[i - 1] >= keys[i]))
+            {
+                spdlog::error("Wrong tree builder key {} in row {}", keys[i], dest);
+                return false;
+            }
+        }
+    }
+
+    return true;
 }
 
 void DepRelStatistics::printStatistics(const TagsCollection& tc, const DepRelsCollection& drc) const
 {
+    if (relations.empty())
+    {
+        spdlog::warn("Relation statistics were not collected");
+        return;
+    }
+
+    std::vector<TagId> seen;
+    for (TagId dest = 0; dest < tagsNum; ++dest)
+    {
+        for (TagId dr = 0; dr < depRelsNum; ++dr)
+        {
+            if (relationCount(dest, dr) != 0)
+            {
+                seen.push_back(dest);
+                break;
+            }
+        }
+    }
+
     std::ofstream stream("dr.csv");
-    stream << "tags\t" << statistics.size() << std::endl;
+    stream << "tags\t" << seen.size() << std::endl;
 
     stream << "TAG/RELNAME" ;
     for (size_t dr = 0; dr < drc.depRelsSize(); ++dr)
@@ -143,7 +599,7 @@ void DepRelStatistics::printStatistics(const TagsCollection& tc, const DepRelsCo
 
     stream << std::endl;
 
-    for (const auto& [t, m]: statistics)
+    for (const TagId t: seen)
     {
         auto ct = tc.getPOSTag(t);
         if (ct)
@@ -153,11 +609,11 @@ void DepRelStatistics::printStatistics(const TagsCollection& tc, const DepRelsCo
         }
         for (size_t dr = 0; dr < drc.depRelsSize(); ++dr)
         {
-            auto v = m.find(dr);
-            if (v == m.end())
+            const uint32_t v = dr < depRelsNum ? relationCount(t, dr) : 0;
+            if (v == 0)
                 stream << "\t 0";
             else
-                stream << "\t" << v->second;
+                stream << "\t" << v;
         }
         stream << std::endl;
     }
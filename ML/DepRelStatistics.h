@@ -1,49 +1,243 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <optional>
 #include <utility>
 #include <unordered_map>
+#include <atomic>
 
 #include "../Engine/Sentence.h"
+#include "../Engine/TraceSink.h"
 #include "../Collections/DepRelsCollection.h"
 #include "../Collections/TagsCollection.h"
 #include "../ZLibFile/ZLibFile.h"
-#include "../Math/Tensor.h"
 #include "../Math/Graph.h"
+#include "../Math/TarjanMST.h"
+#include "../Math/ProjectiveDecoder.h"
+#include "../Math/KBestMST.h"
 
+// Maximum spanning tree algorithm of the tree builder
+enum class TreeSolver : uint8_t
+{
+    ChuLiuEdmonds = 0,
+    Tarjan = 1,
+    // Eisner's decoder, gives projective trees only
+    Projective = 2,
+};
+
+inline bool validTreeSolver(size_t solver)
+{
+    return solver <= size_t(TreeSolver::Projective);
+}
+
+// Smoothed log P(depRel, srcTag | destTag), only seen triples are stored
 class DepRelStatistics
 {
-    typedef Tensor<float, TagId, 3> T;
     typedef Graph<float, TagId> G;
 
-    T stat;
+    // (srcTag, depRel) within the row of a destination tag, so the relations of a tag pair are contiguous
+    typedef uint32_t Key;
+
+    static Key key(TagId depRel, TagId src)
+    {
+        return (Key(src) << (8 * sizeof(TagId))) | depRel;
+    }
+
+    TagId depRelsNum = 0;
+    TagId tagsNum = 0;
+
+public:
+    // Training counts by destination tag, a shard per worker
+    struct Counts
+    {
+        std::vector<std::unordered_map<Key, uint32_t>> rows;
+
+        Counts(TagId tagsNum)
+            : rows(tagsNum)
+        {
+        }
+    };
+
+    // Graph and solver buffers kept between sentences, they grow to the longest sentence seen
+    class Workspace
+    {
+        enum Direction
+        {
+            HeadAfter,
+            HeadBefore,
+            // Arcs from root take relations of both directions
+            AnyDirection,
+            DirectionsNum
+        };
+
+        G graph = G(0, 1);
+        std::vector<TagId> labels;
+        TarjanMST<G> tarjan {graph};
+        ProjectiveDecoder<G> projective {graph};
+        KBestMST<G> kBest {graph};
+
+        // Bit of every direction a relation goes in, 0 for unknown relations
+        std::vector<uint8_t> directions;
+        std::vector<TagId> relations[DirectionsNum];
+
+        // Distinct tags of the sentence and the index of every word among them
+        std::vector<TagId> distinct;
+        std::vector<uint32_t> positions;
+
+        // Best relation of every distinct pair at (dest * distinct + src) * 2 + headBefore
+        std::vector<float> pairScores;
+        std::vector<TagId> pairLabels;
+        std::vector<float> rootScores;
+        std::vector<TagId> rootLabels;
+
+        // log |i1 - i2| at n - 1 + i1 - i2, NaN on self loops
+        std::vector<float> logDistances;
+        std::vector<float> column;
+
+        friend class DepRelStatistics;
+
+    public:
+        Workspace()
+        {
+        }
+
+        Workspace(const Workspace&) = delete;
+        Workspace& operator=(const Workspace&) = delete;
+    };
+
+    static Workspace& threadWorkspace()
+    {
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+private:
+    // Moved into the rows by normalize
+    Counts counts = Counts(0);
+
+    // Row of destination tag d is [offsets[d], offsets[d + 1]), sorted by key
+    std::vector<uint32_t> offsets;
+    std::vector<Key> keys;
+    std::vector<float> logProbs;
+
+    // Unseen triples get logSmoothing - logZ[d]
+    std::vector<float> logZ;
+    float logSmoothing = 0;
+
+    // Relations by destination tag at dest * depRelsNum + depRel for printStatistics,
+    // empty unless asked for, workers count into it directly
+    std::vector<std::atomic<uint32_t>> relations;
+
+    TreeSolver solver = TreeSolver::Tarjan;
+
+    // Graphs and trees of sampled sentences go there, nothing is traced without it
+    TraceSink* traceSink = nullptr;
+
+    std::optional<uint64_t> sampleTrace() const;
 
-    std::unordered_map<TagId, std::unordered_map<TagId, size_t>> statistics;
+    void record(uint64_t trace, const std::string& name, const G::Edges& edges) const;
+
+    static std::optional<G::Edges> spanningTree(G& g, TreeSolver solver);
+
+    static std::optional<G::Edges> spanningTree(Workspace& ws, TreeSolver solver);
+
+    // Best relation of src -> dest in every direction, NaN if there is none
+    void bestRelations(TagId src, TagId dest, const Workspace& ws, float* scores, TagId* labels) const;
+
+    // Best label per (head, dependent) into the workspace graph, labels are kept aside
+    void fillBestLabelGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, Workspace& ws) const;
+
+    static void relabel(const Workspace& ws, G::Edges& edges);
+
+    // Graph with an edge per label, the solver looks through all of them
+    std::optional<G::Edges> extractLabeledGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, TreeSolver solver) const;
+
+    std::optional<G::Edges> extractBestLabelGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, TreeSolver solver) const;
 public:
     typedef G::Edge Edge;
     typedef G::Edges Edges;
+    typedef KBestMST<G>::ScoredTree ScoredTree;
+    typedef std::vector<ScoredTree> ScoredTrees;
 
     DepRelStatistics()
-        : stat()
     {
     }
 
-    DepRelStatistics(TagId depRelsNum, TagId tagsNum)
-        : stat(0, {depRelsNum, tagsNum, tagsNum})
+    DepRelStatistics(TagId depRelsNum, TagId tagsNum, bool relationStatistics = false)
     {
+        resize(depRelsNum, tagsNum, relationStatistics);
     }
 
-    void resize(TagId depRelsNum, TagId tagsNum)
+    // Drops everything trained, relation statistics are collected for printStatistics if asked
+    void resize(TagId depRelsNum, TagId tagsNum, bool relationStatistics = false);
+
+    bool operator==(const DepRelStatistics& other) const;
+
+    // Valid after normalize
+    float logProb(TagId depRel, TagId src, TagId dest) const;
+
+    TagId numDepRels() const
+    {
+        return depRelsNum;
+    }
+
+    TagId numTags() const
     {
-        stat.resize(0, {depRelsNum, tagsNum, tagsNum});
+        return tagsNum;
+    }
+
+    // Stored triples
+    size_t size() const
+    {
+        return keys.size();
+    }
+
+    size_t bytes() const
+    {
+        return offsets.size() * sizeof(uint32_t) + keys.size() * sizeof(Key) + (logProbs.size() + logZ.size()) * sizeof(float);
+    }
+
+    void setSolver(TreeSolver s)
+    {
+        solver = s;
+    }
+
+    TreeSolver getSolver() const
+    {
+        return solver;
+    }
+
+    // Not owned, should outlive tree building, nullptr turns tracing off
+    void setTraceSink(TraceSink* sink)
+    {
+        traceSink = sink;
     }
 
     void processSentence(const TagsCollection& tc, const DepRelsCollection& drc, const Sentence& sentence);
 
+    // Counts the sentence into counts of the worker, safe to call from many threads with their own counts
+    void countSentence(const DepRelsCollection& drc, const Sentence& sentence, Counts& counts);
+
+    // Counts are integers, so merging shards in any order gives the serial result
+    void merge(const Counts& shard);
+
+    // Zero if relation statistics are not collected
+    uint32_t relationCount(TagId dest, TagId depRel) const;
+
     void normalize(float smoothingFactor);
 
-    std::optional<Edges> extractGraph(const TagsCollection& tc, const DepRelsCollection& drc, const std::vector<TagId>& tags);
+    // Arc scores ignore label interactions, so by default labels are reduced to the best one before the tree is built.
+    // Solver of the call, the one set by setSolver if none.
+    std::optional<Edges> extractGraph(const TagsCollection& tc, const DepRelsCollection& drc, const std::vector<TagId>& tags, bool bestLabelOnly = true, std::optional<TreeSolver> solver = std::nullopt) const;
+
+    // Best label tree into result, tags.size() edges sorted by dependent, no files are written.
+    // Safe to call from many threads with their own workspaces.
+    bool extractGraph(const DepRelsCollection& drc, const std::vector<TagId>& tags, Workspace& ws, Edge* result, std::optional<TreeSolver> solver = std::nullopt) const;
+
+    // Up to k best trees of the best label graph by score, best first, edges of every tree sorted by dependent.
+    // The first one is the tree of Tarjan's solver.
+    ScoredTrees extractKBest(const DepRelsCollection& drc, const std::vector<TagId>& tags, size_t k, Workspace& ws) const;
 
     void saveBinary(ZLibFile& zfile) const;
 
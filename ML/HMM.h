@@ -1,9 +1,17 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
 
+#include "SparseEmissions.h"
 #include "../Math/Tensor.h"
+#include "../Math/MaxPlus.h"
+#include "../Math/Quantized.h"
+#include "../Math/FixedHeap.h"
 #include "../ZLibFile/ZLibFile.h"
 
 #include "spdlog/spdlog.h"
@@ -11,8 +19,639 @@
 template<typename N, typename HS, typename ES>
 class HMM
 {
+public:
+    typedef std::vector<HS> States;
+
+    struct Posterior
+    {
+        HS state;
+        N probability;
+    };
+
+    // Hidden state sequence with its log probability
+    struct ScoredStates
+    {
+        std::vector<HS> states;
+        N score;
+    };
+
+    // Scratch buffers of Viterbi, they grow to the longest sentence seen and are reused afterwards
+    class DecodeWorkspace
+    {
+        friend class HMM<N, HS, ES>;
+
+        // Entry of the k best list of a (position, state) cell, prev is the flat index of the entry it extends
+        struct NBestEntry
+        {
+            N score;
+            uint32_t prev;
+
+            // Ties prefer earlier entries as Viterbi prefers earlier states
+            bool operator<(const NBestEntry& other) const
+            {
+                return score < other.score || (score == other.score && prev > other.prev);
+            }
+        };
+
+        std::vector<NBestEntry> nbest;
+        std::vector<uint32_t> nbestSizes;
+        std::vector<NBestEntry> finals;
+        FixedHeap<NBestEntry> candidates = FixedHeap<NBestEntry>(0);
+
+        std::vector<const States*> states;
+        std::vector<size_t> offsets;
+        std::vector<N> prob;
+        // Indexes in the states of the previous position, so hidden state type is enough
+        std::vector<HS> prev;
+        std::vector<N> transitions;
+        std::vector<N> emissionScores;
+    };
+
+    // Emission log probabilities of every hidden state replacing the model ones at some positions,
+    // e.g. estimated for unknown words, empty row means the model is used
+    typedef std::vector<std::vector<N>> EmissionOverrides;
+
+    // Raw counts, several of them can be filled independently and merged before normalization.
+    // HMM keeps its own counts after normalization, so new data can be added later.
+    class Counts
+    {
+        friend class HMM<N, HS, ES>;
+
+        HS hsNum = 0;
+
+        // Keyed by src * hsNum + dst
+        std::unordered_map<uint64_t, uint32_t> transitions;
+        // Keyed by es * hsNum + hs, as SparseEmissions expects
+        std::unordered_map<uint64_t, uint32_t> emissions;
+
+    public:
+        Counts(HS hiddenStates = 0)
+            : hsNum(hiddenStates)
+        {
+        }
+
+        bool operator==(const Counts& other) const
+        {
+            return hsNum == other.hsNum && transitions == other.transitions && emissions == other.emissions;
+        }
+
+        // Keys depend on the number of hidden states
+        void resize(HS hiddenStates)
+        {
+            std::unordered_map<uint64_t, uint32_t> oldTransitions;
+            std::unordered_map<uint64_t, uint32_t> oldEmissions;
+            oldTransitions.swap(transitions);
+            oldEmissions.swap(emissions);
+
+            for (const auto& [k, c]: oldTransitions)
+            {
+                transitions[k / hsNum * hiddenStates + k % hsNum] = c;
+            }
+
+            for (const auto& [k, c]: oldEmissions)
+            {
+                emissions[k / hsNum * hiddenStates + k % hsNum] = c;
+            }
+
+            hsNum = hiddenStates;
+        }
+
+        void addHiddenState2HiddenState(HS srcHS, HS dstHS)
+        {
+            ++transitions[uint64_t(srcHS) * hsNum + dstHS];
+        }
+
+        void addHiddenState2Emission(HS srcHS, ES dstES)
+        {
+            ++emissions[uint64_t(dstES) * hsNum + srcHS];
+        }
+
+        // Times every emission below frequencies.size() was counted, added to frequencies
+        void addEmissionFrequencies(std::vector<size_t>& frequencies) const
+        {
+            for (const auto& [k, c]: emissions)
+            {
+                const uint64_t es = k / hsNum;
+                if (es < frequencies.size())
+                {
+                    frequencies[es] += c;
+                }
+            }
+        }
+
+        void merge(const Counts& other)
+        {
+            for (const auto& [k, c]: other.transitions)
+            {
+                transitions[k] += c;
+            }
+
+            for (const auto& [k, c]: other.emissions)
+            {
+                emissions[k] += c;
+            }
+        }
+    };
+
+private:
+    template<typename, typename, typename>
+    friend class StreamingViterbi;
+
     Tensor<N, HS, 2> hss2hs;
-    Tensor<N, ES, 2> hss2es;
+    SparseEmissions<N, HS, ES> hss2es;
+
+    // Transitions into every hidden state replace hss2hs once quantized
+    Storage storage = Storage::Float32;
+    QuantizedRows<N> quantizedTransitions;
+
+    Counts counts;
+    N smoothingFactor = 0;
+
+    // Rows whose counts changed since the last normalization, transitions by source and emissions by hidden state
+    std::vector<bool> dirtyTransitions;
+    std::vector<bool> dirtyEmissions;
+    // New (hidden state, emission) pairs change the layout of sparse emissions
+    bool rebuildEmissions = false;
+
+    void markAllDirty()
+    {
+        dirtyTransitions.assign(numHiddenStates(), true);
+        dirtyEmissions.assign(numHiddenStates(), true);
+        rebuildEmissions = true;
+    }
+
+    // Dirty rows are read by key, so the work does not depend on the counts of clean rows
+    void normalizeTransitions()
+    {
+        const HS hsNum = numHiddenStates();
+
+        std::vector<uint32_t> row(hsNum);
+        for (HS src = 0; src < hsNum; ++src)
+        {
+            if (!dirtyTransitions[src])
+            {
+                continue;
+            }
+
+            // Sums are exact in double, so dirty rows get the same values as in full normalization
+            double total = 0;
+            for (HS dst = 0; dst < hsNum; ++dst)
+            {
+                const auto it = counts.transitions.find(uint64_t(src) * hsNum + dst);
+                row[dst] = it == counts.transitions.end() ? 0 : it->second;
+                total += row[dst];
+            }
+
+            const N sum = std::log(N(total) + smoothingFactor * hsNum);
+            for (HS dst = 0; dst < hsNum; ++dst)
+            {
+                hss2hs.at(src, dst) = std::log(N(row[dst]) + smoothingFactor) - sum;
+            }
+        }
+    }
+
+    static const States& allStates(HS hsNum)
+    {
+        thread_local States all;
+        if (all.size() != hsNum)
+        {
+            all.resize(hsNum);
+            std::iota(all.begin(), all.end(), HS(0));
+        }
+        return all;
+    }
+
+    const States& allowedStates(const std::vector<States>* allowed, size_t i) const
+    {
+        const bool restricted = allowed && !(*allowed)[i].empty();
+        return restricted ? (*allowed)[i] : allStates(numHiddenStates());
+    }
+
+    // Transitions from every state of the list into hsTo, contiguous for the full list
+    const N* gatherTransitions(const States& from, HS hsTo, std::vector<N>& buffer) const
+    {
+        if (&from == &allStates(numHiddenStates()))
+        {
+            if (storage == Storage::Float32)
+            {
+                return &hss2hs.at(0, hsTo);
+            }
+
+            // Quantized column is decoded as a whole
+            buffer.resize(from.size());
+            quantizedTransitions.decode(hsTo, buffer.data());
+            return buffer.data();
+        }
+
+        buffer.resize(from.size());
+        for (size_t j = 0; j < from.size(); ++j)
+        {
+            buffer[j] = transition(from[j], hsTo);
+        }
+        return buffer.data();
+    }
+
+    static DecodeWorkspace& threadWorkspace()
+    {
+        thread_local DecodeWorkspace workspace;
+        return workspace;
+    }
+
+    void nBestSequences(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const EmissionOverrides* overrides, size_t k, std::vector<ScoredStates>& res) const
+    {
+        std::vector<HS> paths;
+        std::vector<N> scores;
+        if (!predictNBest(serviceTag, emissions, allowed, overrides, k, threadWorkspace(), paths, scores))
+        {
+            return;
+        }
+
+        res.resize(scores.size());
+        for (size_t p = 0; p < scores.size(); ++p)
+        {
+            res[p].states.assign(paths.begin() + p * emissions.size(), paths.begin() + (p + 1) * emissions.size());
+            res[p].score = scores[p];
+        }
+    }
+
+    void layout(const std::vector<States>* allowed, size_t seqSize, DecodeWorkspace& ws) const
+    {
+        ws.states.resize(seqSize);
+        ws.offsets.resize(seqSize + 1);
+        ws.offsets[0] = 0;
+        for (size_t i = 0; i < seqSize; ++i)
+        {
+            ws.states[i] = &allowedStates(allowed, i);
+            ws.offsets[i + 1] = ws.offsets[i] + ws.states[i]->size();
+        }
+    }
+
+    void viterbi(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const EmissionOverrides* overrides, DecodeWorkspace& ws, std::vector<HS>& res) const
+    {
+        const size_t seqSize = emissions.size();
+
+        res.resize(seqSize);
+        if (seqSize == 0)
+        {
+            return;
+        }
+
+        // Scores and back pointers of position i are stored in [offsets[i], offsets[i + 1])
+        layout(allowed, seqSize, ws);
+
+        const auto& states = ws.states;
+        const auto& offsets = ws.offsets;
+        auto& prob = ws.prob;
+        auto& prev = ws.prev;
+
+        prob.assign(offsets[seqSize], -std::numeric_limits<N>::infinity());
+        prev.assign(offsets[seqSize], 0);
+        ws.emissionScores.resize(numHiddenStates());
+
+        emissionRow(emissions, overrides, 0, ws.emissionScores.data());
+        for (size_t k = 0; k < states[0]->size(); ++k)
+        {
+            const HS hsTo = (*states[0])[k];
+            prob[k] = transition(serviceTag, hsTo) + ws.emissionScores[hsTo];
+        }
+
+        for (size_t i = 1; i < seqSize; ++i)
+        {
+            const States& from = *states[i - 1];
+            const N* probPrev = &prob[offsets[i - 1]];
+
+            emissionRow(emissions, overrides, i, ws.emissionScores.data());
+            for (size_t k = 0; k < states[i]->size(); ++k)
+            {
+                const HS hsTo = (*states[i])[k];
+                prev[offsets[i] + k] = maxPlus(probPrev, gatherTransitions(from, hsTo, ws.transitions), ws.emissionScores[hsTo], from.size(), prob[offsets[i] + k]);
+            }
+        }
+
+        // Back pointers are indexes in the allowed states of the previous position
+        const States& last = *states[seqSize - 1];
+        N pMax = -std::numeric_limits<N>::infinity();
+        HS ix = maxPlus(&prob[offsets[seqSize - 1]], gatherTransitions(last, serviceTag, ws.transitions), N(0), last.size(), pMax);
+        res[seqSize - 1] = last[ix];
+        if (pMax == -std::numeric_limits<N>::infinity())
+        {
+            const auto it = std::find(last.begin(), last.end(), serviceTag);
+            ix = it == last.end() ? 0 : it - last.begin();
+            res[seqSize - 1] = serviceTag;
+        }
+
+        for (size_t i = seqSize - 1; i != 0; --i)
+        {
+            ix = prev[offsets[i] + ix];
+            res[i - 1] = (*states[i - 1])[ix];
+        }
+    }
+
+    // List Viterbi: every (position, state) cell keeps its k best partial sequences sorted by score.
+    // Entries of cell c are [c * k, c * k + nbestSizes[c]), paths are written one after another.
+    void nBest(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const EmissionOverrides* overrides, size_t k, DecodeWorkspace& ws, std::vector<HS>& paths, std::vector<N>& scores) const
+    {
+        typedef typename DecodeWorkspace::NBestEntry Entry;
+
+        const size_t seqSize = emissions.size();
+
+        paths.clear();
+        scores.clear();
+        if (seqSize == 0)
+        {
+            return;
+        }
+
+        layout(allowed, seqSize, ws);
+
+        const auto& states = ws.states;
+        const auto& offsets = ws.offsets;
+        auto& nbest = ws.nbest;
+        auto& sizes = ws.nbestSizes;
+        auto& candidates = ws.candidates;
+
+        nbest.resize(offsets[seqSize] * k);
+        sizes.assign(offsets[seqSize], 0);
+        candidates.reset(k);
+        ws.emissionScores.resize(numHiddenStates());
+
+        auto store = [&](std::vector<Entry>& out, size_t first)
+        {
+            std::copy(candidates.begin(), candidates.end(), out.begin() + first);
+            std::sort(out.begin() + first, out.begin() + first + candidates.size(), [](const Entry& a, const Entry& b) { return b < a; });
+        };
+
+        emissionRow(emissions, overrides, 0, ws.emissionScores.data());
+        for (size_t c = 0; c < states[0]->size(); ++c)
+        {
+            const HS hsTo = (*states[0])[c];
+            nbest[c * k] = {transition(serviceTag, hsTo) + ws.emissionScores[hsTo], 0};
+            sizes[c] = 1;
+        }
+
+        // Candidates extending one cell come sorted, so the first rejected one ends that cell
+        auto extend = [&](size_t i, HS hsTo, N score)
+        {
+            const States& from = *states[i];
+            for (size_t j = 0; j < from.size(); ++j)
+            {
+                const size_t cell = offsets[i] + j;
+                const N trans = transition(from[j], hsTo);
+                for (uint32_t r = 0; r < sizes[cell]; ++r)
+                {
+                    // Same order of additions as in Viterbi, so the best sequence is the same
+                    const uint32_t prev = cell * k + r;
+                    if (!candidates.push({nbest[prev].score + trans + score, prev}))
+                    {
+                        break;
+                    }
+                }
+            }
+        };
+
+        for (size_t i = 1; i < seqSize; ++i)
+        {
+            emissionRow(emissions, overrides, i, ws.emissionScores.data());
+            for (size_t c = 0; c < states[i]->size(); ++c)
+            {
+                const HS hsTo = (*states[i])[c];
+                const size_t cell = offsets[i] + c;
+
+                candidates.clear();
+                extend(i - 1, hsTo, ws.emissionScores[hsTo]);
+                store(nbest, cell * k);
+                sizes[cell] = candidates.size();
+            }
+        }
+
+        candidates.clear();
+        extend(seqSize - 1, serviceTag, N(0));
+        ws.finals.resize(candidates.size());
+        store(ws.finals, 0);
+
+        paths.resize(ws.finals.size() * seqSize);
+        scores.resize(ws.finals.size());
+        for (size_t p = 0; p < ws.finals.size(); ++p)
+        {
+            scores[p] = ws.finals[p].score;
+
+            uint32_t ix = ws.finals[p].prev;
+            for (size_t i = seqSize; i != 0; --i)
+            {
+                const size_t cell = ix / k;
+                paths[p * seqSize + i - 1] = (*states[i - 1])[cell - offsets[i - 1]];
+                ix = nbest[ix].prev;
+            }
+        }
+    }
+
+    // Transitions from hsFrom into every state of the list
+    const N* gatherTransitionsFrom(HS hsFrom, const States& to, std::vector<N>& buffer) const
+    {
+        buffer.resize(to.size());
+        for (size_t j = 0; j < to.size(); ++j)
+        {
+            buffer[j] = transition(hsFrom, to[j]);
+        }
+        return buffer.data();
+    }
+
+    // Log-space forward-backward, returns k most probable hidden states for every emission,
+    // sorted by probability, positions with less than k allowed states are padded with zero probabilities
+    std::vector<Posterior> forwardBackward(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const EmissionOverrides* overrides, size_t k) const
+    {
+        if (emissions.empty() || k == 0)
+        {
+            spdlog::debug("No input provided");
+            return std::vector<Posterior>();
+        }
+
+        const HS hsNum = numHiddenStates();
+        const size_t seqSize = emissions.size();
+
+        std::vector<const States*> states(seqSize);
+        std::vector<size_t> offsets(seqSize + 1, 0);
+        for (size_t i = 0; i < seqSize; ++i)
+        {
+            states[i] = &allowedStates(allowed, i);
+            offsets[i + 1] = offsets[i] + states[i]->size();
+        }
+
+        std::vector<N> alpha(offsets[seqSize], -std::numeric_limits<N>::infinity());
+        std::vector<N> beta(offsets[seqSize], -std::numeric_limits<N>::infinity());
+        std::vector<N> transitions;
+        std::vector<N> emissionScores(hsNum);
+
+        emissionRow(emissions, overrides, 0, emissionScores.data());
+        for (size_t j = 0; j < states[0]->size(); ++j)
+        {
+            const HS hsTo = (*states[0])[j];
+            alpha[j] = transition(serviceTag, hsTo) + emissionScores[hsTo];
+        }
+
+        for (size_t i = 1; i < seqSize; ++i)
+        {
+            const States& from = *states[i - 1];
+
+            emissionRow(emissions, overrides, i, emissionScores.data());
+            for (size_t j = 0; j < states[i]->size(); ++j)
+            {
+                const HS hsTo = (*states[i])[j];
+                alpha[offsets[i] + j] = logSumExp(&alpha[offsets[i - 1]], gatherTransitions(from, hsTo, transitions), emissionScores[hsTo], from.size());
+            }
+        }
+
+        const States& last = *states[seqSize - 1];
+        for (size_t j = 0; j < last.size(); ++j)
+        {
+            beta[offsets[seqSize - 1] + j] = transition(last[j], serviceTag);
+        }
+
+        // Emission of the next position is added to its backward score once, not for every source
+        std::vector<N> next;
+        for (size_t i = seqSize - 1; i != 0; --i)
+        {
+            const States& to = *states[i];
+
+            emissionRow(emissions, overrides, i, emissionScores.data());
+            next.resize(to.size());
+            for (size_t j = 0; j < to.size(); ++j)
+            {
+                next[j] = emissionScores[to[j]] + beta[offsets[i] + j];
+            }
+
+            for (size_t j = 0; j < states[i - 1]->size(); ++j)
+            {
+                beta[offsets[i - 1] + j] = logSumExp(next.data(), gatherTransitionsFrom((*states[i - 1])[j], to, transitions), N(0), to.size());
+            }
+        }
+
+        const N logZ = logSumExp(&alpha[offsets[seqSize - 1]], &beta[offsets[seqSize - 1]], N(0), last.size());
+
+        std::vector<Posterior> res(seqSize * k, Posterior{serviceTag, N(0)});
+        std::vector<Posterior> position;
+        for (size_t i = 0; i < seqSize; ++i)
+        {
+            position.resize(states[i]->size());
+            for (size_t j = 0; j < position.size(); ++j)
+            {
+                const N p = logZ == -std::numeric_limits<N>::infinity() ? N(0) : std::exp(alpha[offsets[i] + j] + beta[offsets[i] + j] - logZ);
+                position[j] = {(*states[i])[j], p};
+            }
+
+            const size_t top = std::min(k, position.size());
+            std::partial_sort(position.begin(), position.begin() + top, position.end(), [](const auto& a, const auto& b)
+            {
+                return a.probability > b.probability || (a.probability == b.probability && a.state < b.state);
+            });
+            std::copy(position.begin(), position.begin() + top, res.begin() + i * k);
+        }
+
+        return res;
+    }
+
+    struct BeamEntry
+    {
+        N score;
+        HS state;
+        HS prev;
+
+        bool operator<(const BeamEntry& other) const
+        {
+            return score < other.score;
+        }
+    };
+
+    std::vector<HS> beam(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const EmissionOverrides* overrides, size_t beamWidth) const
+    {
+        if (emissions.empty())
+        {
+            spdlog::debug("No input provided");
+            return std::vector<HS>();
+        }
+
+        if (beamWidth == 0)
+        {
+            spdlog::error("Beam width should be positive");
+            return std::vector<HS>();
+        }
+
+        const size_t seqSize = emissions.size();
+        const size_t width = std::min<size_t>(beamWidth, numHiddenStates());
+
+        // Position i keeps sizes[i] best states in [i * width, i * width + sizes[i])
+        std::vector<N> scores(seqSize * width, -std::numeric_limits<N>::infinity());
+        std::vector<HS> states(seqSize * width, 0);
+        std::vector<HS> prev(seqSize * width, 0);
+        std::vector<size_t> sizes(seqSize, 0);
+
+        std::vector<N> transitions(width);
+        std::vector<N> emissionScores(numHiddenStates());
+        std::vector<BeamEntry> entries(width);
+        FixedHeap<BeamEntry> heap(width);
+
+        auto storeBeam = [&](size_t i)
+        {
+            // Sorting by state resolves ties the same way exact Viterbi does
+            auto end = std::copy(heap.begin(), heap.end(), entries.begin());
+            std::sort(entries.begin(), end, [](const auto& a, const auto& b) { return a.state < b.state; });
+
+            sizes[i] = heap.size();
+            for (size_t k = 0; k < sizes[i]; ++k)
+            {
+                scores[i * width + k] = entries[k].score;
+                states[i * width + k] = entries[k].state;
+                prev[i * width + k] = entries[k].prev;
+            }
+            heap.clear();
+        };
+
+        emissionRow(emissions, overrides, 0, emissionScores.data());
+        for (const HS hsTo: allowedStates(allowed, 0))
+        {
+            heap.push({transition(serviceTag, hsTo) + emissionScores[hsTo], hsTo, 0});
+        }
+        storeBeam(0);
+
+        for (size_t i = 1; i < seqSize; ++i)
+        {
+            const size_t from = (i - 1) * width;
+
+            emissionRow(emissions, overrides, i, emissionScores.data());
+            for (const HS hsTo: allowedStates(allowed, i))
+            {
+                for (size_t j = 0; j < sizes[i - 1]; ++j)
+                {
+                    transitions[j] = transition(states[from + j], hsTo);
+                }
+
+                N p = 0;
+                const size_t j = maxPlus(&scores[from], transitions.data(), emissionScores[hsTo], sizes[i - 1], p);
+                heap.push({p, hsTo, HS(j)});
+            }
+            storeBeam(i);
+        }
+
+        std::vector<HS> res(seqSize);
+
+        const size_t last = (seqSize - 1) * width;
+        for (size_t j = 0; j < sizes[seqSize - 1]; ++j)
+        {
+            transitions[j] = transition(states[last + j], serviceTag);
+        }
+
+        N pMax = -std::numeric_limits<N>::infinity();
+        HS ix = maxPlus(&scores[last], transitions.data(), N(0), sizes[seqSize - 1], pMax);
+        res[seqSize - 1] = pMax == -std::numeric_limits<N>::infinity() ? serviceTag : states[last + ix];
+
+        for (size_t i = seqSize - 1; i != 0; --i)
+        {
+            ix = prev[i * width + ix];
+            res[i - 1] = states[(i - 1) * width + ix];
+        }
+
+        return res;
+    }
 
 public:
     HMM()
@@ -22,116 +661,450 @@ public:
     };
 
     HMM(HS hiddenStates, ES emissions)
-        : hss2hs(0, {hiddenStates, hiddenStates})
-        , hss2es(0, {hiddenStates, emissions})
+        : hss2hs()
+        , hss2es()
     {
+        resize(hiddenStates, emissions);
     };
 
     ~HMM() {}
 
+    void swap(HMM<N, HS, ES>& other)
+    {
+        hss2hs.swap(other.hss2hs);
+        std::swap(hss2es, other.hss2es);
+        std::swap(storage, other.storage);
+        std::swap(quantizedTransitions, other.quantizedTransitions);
+        std::swap(counts, other.counts);
+        std::swap(smoothingFactor, other.smoothingFactor);
+        dirtyTransitions.swap(other.dirtyTransitions);
+        dirtyEmissions.swap(other.dirtyEmissions);
+        std::swap(rebuildEmissions, other.rebuildEmissions);
+    }
+
     bool operator==(const HMM<N, HS, ES>& other) const
     {
-        return hss2hs == other.hss2hs && hss2es == other.hss2es;
+        return storage == other.storage
+            && hss2hs == other.hss2hs
+            && hss2es == other.hss2es
+            && (storage == Storage::Float32 || quantizedTransitions == other.quantizedTransitions);
     }
     
     void resize(HS hiddenStates, ES emissions)
     {
         spdlog::debug("Resize HMM {} {}", hiddenStates, emissions);
         hss2hs.resize(0, {hiddenStates, hiddenStates});
-        hss2es.resize(0, {hiddenStates, emissions});
+        hss2es.resize(hiddenStates, emissions);
+        storage = Storage::Float32;
+        quantizedTransitions = QuantizedRows<N>();
+        counts = Counts(hiddenStates);
+        markAllDirty();
     }
 
-    void addHiddenState2HiddenState(HS srcHS, HS dstHS)
+    // Keeps counts, the model has to be renormalized afterwards
+    void grow(HS hiddenStates, ES emissions)
     {
-        ++hss2hs.at(srcHS, dstHS);
+        if (storage != Storage::Float32)
+        {
+            spdlog::error("Quantized HMM can not grow");
+            return;
+        }
+
+        const HS hsNum = numHiddenStates();
+        if (hiddenStates == hsNum && emissions == hss2es.numEmissions())
+        {
+            return;
+        }
+
+        spdlog::debug("Grow HMM {} {}", hiddenStates, emissions);
+
+        // Smoothing of every emission row depends on the number of emissions
+        hss2es.resize(hiddenStates, emissions);
+
+        if (hiddenStates != hsNum)
+        {
+            hss2hs.resize(0, {hiddenStates, hiddenStates});
+            counts.resize(hiddenStates);
+            markAllDirty();
+            return;
+        }
+
+        // Transitions are kept, only rows with new counts are renormalized
+        dirtyEmissions.assign(hsNum, true);
+        rebuildEmissions = true;
     }
 
-    void addHiddenState2Emission(HS srcHS, ES dstES)
+    void addHiddenState2HiddenState(HS srcHS, HS dstHS)
     {
-        ++hss2es.at(srcHS, dstES);
+        counts.addHiddenState2HiddenState(srcHS, dstHS);
+        dirtyTransitions[srcHS] = true;
     }
 
-    void normalize(double smoothingFactor)
+    void addHiddenState2Emission(HS srcHS, ES dstES)
     {
-        spdlog::debug("Normalizing HMM {}", smoothingFactor);
-        hss2hs.normalizeLog(smoothingFactor, 0);
-        hss2es.normalizeLog(smoothingFactor, 0);
+        const auto [it, inserted] = counts.emissions.try_emplace(uint64_t(dstES) * counts.hsNum + srcHS, 0);
+        ++it->second;
+        dirtyEmissions[srcHS] = true;
+        rebuildEmissions = rebuildEmissions || inserted;
     }
 
-    std::vector<HS> predict(HS serviceTag, const std::vector<ES>& emissions) const
+    // Counts are integers, so the result does not depend on the order of merges
+    void merge(const Counts& other)
     {
-        spdlog::debug("Predicting by HMM");
+        const HS hsNum = counts.hsNum;
 
-        if (emissions.empty())
+        for (const auto& [k, c]: other.transitions)
         {
-            spdlog::debug("No input provided");
-            return std::vector<HS>();
+            counts.transitions[k] += c;
+            dirtyTransitions[k / hsNum] = true;
         }
 
-        const HS hsNum = hss2es.sizeAt(0);
-        const size_t seqSize = emissions.size();
+        for (const auto& [k, c]: other.emissions)
+        {
+            const auto [it, inserted] = counts.emissions.try_emplace(k, 0);
+            it->second += c;
+            dirtyEmissions[k % hsNum] = true;
+            rebuildEmissions = rebuildEmissions || inserted;
+        }
+    }
 
-        Tensor<N, size_t, 2> prob(-std::numeric_limits<N>::infinity(), {seqSize, hsNum});
-        Tensor<N, size_t, 2> prev(0, {seqSize, hsNum});
+    const Counts& getCounts() const
+    {
+        return counts;
+    }
+
+    HS numHiddenStates() const
+    {
+        return hss2es.numHiddenStates();
+    }
+
+    N transition(HS srcHS, HS dstHS) const
+    {
+        return storage == Storage::Float32 ? hss2hs.at(srcHS, dstHS) : quantizedTransitions.at(dstHS, srcHS);
+    }
 
-        std::vector<N> inits(hsNum);
-        for (size_t i = 0; i < inits.size(); ++i)
+    N emission(HS srcHS, ES dstES) const
+    {
+        return hss2es.at(srcHS, dstES);
+    }
+
+    // Log probabilities of dstES for all hidden states, row should have numHiddenStates() elements
+    void emissionRow(ES dstES, N* row) const
+    {
+        hss2es.fill(dstES, row);
+    }
+
+    bool validInput(const std::vector<ES>& emissions, const std::vector<States>& allowed, const EmissionOverrides* overrides) const
+    {
+        if (allowed.size() != emissions.size())
         {
-            inits[i] = hss2hs.at(serviceTag, i);
+            spdlog::error("Allowed states provided for {} of {} emissions", allowed.size(), emissions.size());
+            return false;
         }
 
-        for(HS hsTo = 0; hsTo < hsNum; hsTo++)
+        return validInput(emissions, overrides);
+    }
+
+    bool validInput(const std::vector<ES>& emissions, const EmissionOverrides* overrides) const
+    {
+        if (overrides && overrides->size() != emissions.size())
         {
-            prob.at(0, hsTo) = inits[hsTo] + hss2es.at(hsTo, emissions[0]);
+            spdlog::error("Emission overrides provided for {} of {} emissions", overrides->size(), emissions.size());
+            return false;
         }
 
-        for (size_t i = 1; i < seqSize; ++i)
+        for (size_t i = 0; overrides && i < overrides->size(); ++i)
         {
-            for(HS hsTo = 0; hsTo < hsNum; hsTo++)
+            if (!(*overrides)[i].empty() && (*overrides)[i].size() != numHiddenStates())
             {
-                for(HS hsFrom = 0; hsFrom < hsNum; hsFrom++)
-                {
-                    N p = prob.at(i - 1, hsFrom) + hss2hs.at(hsFrom, hsTo) + hss2es.at(hsTo, emissions[i]);
-                    if (p > prob.at(i, hsTo))
-                    {
-                        prob.at(i, hsTo) = p;
-                        prev.at(i, hsTo) = hsFrom;
-                    }
-                }
+                spdlog::error("Emission override {} has {} hidden states instead of {}", i, (*overrides)[i].size(), numHiddenStates());
+                return false;
             }
         }
 
-        std::vector<HS> res(seqSize);
+        return true;
+    }
 
-        N pMax = -std::numeric_limits<N>::infinity();
-        res[emissions.size() - 1] = serviceTag;
-        for(HS hsFrom = 0; hsFrom < hsNum; hsFrom++)
+    // Model emissions or the override of position i
+    void emissionRow(const std::vector<ES>& emissions, const EmissionOverrides* overrides, size_t i, N* row) const
+    {
+        if (overrides && !(*overrides)[i].empty())
         {
-            N p = prob.at(emissions.size() - 1, hsFrom) + hss2hs.at(hsFrom, serviceTag);
-            if (p > pMax)
-            {
-                pMax = p;
-                res[emissions.size() - 1] = hsFrom;
-            }
+            std::copy((*overrides)[i].begin(), (*overrides)[i].end(), row);
+            return;
         }
 
-        for (size_t i = emissions.size() - 1; i != 0; --i)
+        hss2es.fill(emissions[i], row);
+    }
+
+    void normalize(double smoothingFactor)
+    {
+        spdlog::debug("Normalizing HMM {}", smoothingFactor);
+
+        if (storage != Storage::Float32)
         {
-            res[i - 1] = prev.at(i, res[i]);
+            spdlog::error("Quantized HMM can not be normalized, resize it first");
+            return;
         }
 
+        this->smoothingFactor = smoothingFactor;
+        markAllDirty();
+        renormalize();
+    }
+
+    // Updates only rows whose counts changed since the last normalization
+    void renormalize()
+    {
+        spdlog::debug("Renormalizing HMM {}", smoothingFactor);
+
+        if (storage != Storage::Float32)
+        {
+            spdlog::error("Quantized HMM can not be renormalized");
+            return;
+        }
+
+        normalizeTransitions();
+
+        if (rebuildEmissions)
+        {
+            hss2es.normalize(counts.emissions, smoothingFactor);
+        }
+        else
+        {
+            hss2es.renormalize(counts.emissions, smoothingFactor, dirtyEmissions);
+        }
+
+        dirtyTransitions.assign(numHiddenStates(), false);
+        dirtyEmissions.assign(numHiddenStates(), false);
+        rebuildEmissions = false;
+    }
+
+    Storage getStorage() const
+    {
+        return storage;
+    }
+
+    // Bytes taken by transition and emission log probabilities, counts are not included
+    size_t bytes() const
+    {
+        const size_t transitions = storage == Storage::Float32 ? hss2hs.size() * sizeof(N) : quantizedTransitions.bytes();
+        return transitions + hss2es.bytes();
+    }
+
+    // Post-training compaction: log probabilities are stored as fp16 or int8 with per row scales.
+    // Counts are dropped, so the model can not be trained further until it is resized.
+    bool quantize(Storage target)
+    {
+        if (storage != Storage::Float32)
+        {
+            spdlog::error("HMM is already quantized");
+            return false;
+        }
+
+        if (target == Storage::Float32)
+        {
+            return true;
+        }
+
+        spdlog::debug("Quantizing HMM {}", uint8_t(target));
+
+        // Tensor column of hsTo is row hsTo of the quantized transitions
+        const HS hsNum = numHiddenStates();
+        std::vector<uint32_t> offsets(size_t(hsNum) + 1);
+        for (size_t i = 0; i < offsets.size(); ++i)
+        {
+            offsets[i] = i * hsNum;
+        }
+
+        quantizedTransitions.encode(target, &hss2hs.at(0, 0), offsets);
+        hss2es.quantize(target);
+        hss2hs.resize(0, {0, 0});
+        storage = target;
+
+        counts = Counts(hsNum);
+        dirtyTransitions.assign(hsNum, false);
+        dirtyEmissions.assign(hsNum, false);
+        rebuildEmissions = false;
+
+        return true;
+    }
+
+    // Viterbi over all hidden states
+    std::vector<HS> predict(HS serviceTag, const std::vector<ES>& emissions) const
+    {
+        std::vector<HS> res;
+        viterbi(serviceTag, emissions, nullptr, nullptr, threadWorkspace(), res);
         return res;
     };
 
+    // Viterbi restricted to the allowed hidden states for every emission,
+    // empty set of allowed states means all hidden states are considered.
+    // States must be sorted to keep ties resolved the same way as in unrestricted mode.
+    std::vector<HS> predict(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>& allowed, const EmissionOverrides* overrides = nullptr) const
+    {
+        std::vector<HS> res;
+        predict(serviceTag, emissions, &allowed, overrides, threadWorkspace(), res);
+        return res;
+    };
+
+    // Viterbi into result with the given scratch buffers, allowed states and overrides are optional.
+    // Does not allocate once workspace and result have grown to the sentence size.
+    bool predict(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const EmissionOverrides* overrides, DecodeWorkspace& workspace, std::vector<HS>& result) const
+    {
+        if (allowed ? !validInput(emissions, *allowed, overrides) : !validInput(emissions, overrides))
+        {
+            result.clear();
+            return false;
+        }
+
+        viterbi(serviceTag, emissions, allowed, overrides, workspace, result);
+        return true;
+    }
+
+    // k most probable hidden state sequences with their log probabilities, best first.
+    // Fewer sequences are returned if there are not that many.
+    std::vector<ScoredStates> predictNBest(HS serviceTag, const std::vector<ES>& emissions, size_t k) const
+    {
+        std::vector<ScoredStates> res;
+        nBestSequences(serviceTag, emissions, nullptr, nullptr, k, res);
+        return res;
+    }
+
+    std::vector<ScoredStates> predictNBest(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>& allowed, size_t k, const EmissionOverrides* overrides = nullptr) const
+    {
+        std::vector<ScoredStates> res;
+        nBestSequences(serviceTag, emissions, &allowed, overrides, k, res);
+        return res;
+    }
+
+    // Sequence p is paths[p * emissions.size(), (p + 1) * emissions.size()) with score scores[p].
+    // Does not allocate once workspace and outputs have grown to the sentence size and k.
+    bool predictNBest(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const EmissionOverrides* overrides, size_t k, DecodeWorkspace& workspace, std::vector<HS>& paths, std::vector<N>& scores) const
+    {
+        if (k == 0)
+        {
+            spdlog::error("Number of sequences should be positive");
+            paths.clear();
+            scores.clear();
+            return false;
+        }
+
+        if (allowed ? !validInput(emissions, *allowed, overrides) : !validInput(emissions, overrides))
+        {
+            paths.clear();
+            scores.clear();
+            return false;
+        }
+
+        nBest(serviceTag, emissions, allowed, overrides, k, workspace, paths, scores);
+        return true;
+    }
+
+    // Posterior probabilities of k most probable hidden states for every emission, k entries per emission
+    std::vector<Posterior> posteriors(HS serviceTag, const std::vector<ES>& emissions, size_t k) const
+    {
+        spdlog::debug("Posteriors by HMM");
+
+        return forwardBackward(serviceTag, emissions, nullptr, nullptr, k);
+    }
+
+    std::vector<Posterior> posteriors(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>& allowed, size_t k, const EmissionOverrides* overrides = nullptr) const
+    {
+        spdlog::debug("Posteriors by HMM with restricted states");
+
+        if (!validInput(emissions, allowed, overrides))
+        {
+            return std::vector<Posterior>();
+        }
+
+        return forwardBackward(serviceTag, emissions, &allowed, overrides, k);
+    }
+
+    // Beam search keeping only beamWidth best hidden states at every position
+    std::vector<HS> predictBeam(HS serviceTag, const std::vector<ES>& emissions, size_t beamWidth) const
+    {
+        spdlog::debug("Predicting by HMM with beam {}", beamWidth);
+
+        return beam(serviceTag, emissions, nullptr, nullptr, beamWidth);
+    }
+
+    std::vector<HS> predictBeam(HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>& allowed, size_t beamWidth, const EmissionOverrides* overrides = nullptr) const
+    {
+        spdlog::debug("Predicting by HMM with beam {} and restricted states", beamWidth);
+
+        if (!validInput(emissions, allowed, overrides))
+        {
+            return std::vector<HS>();
+        }
+
+        return beam(serviceTag, emissions, &allowed, overrides, beamWidth);
+    }
+
+    // Quantized models are saved without counts
     void saveBinary(ZLibFile& zfile) const
     {
+        zfile.write(uint8_t(storage));
+
+        if (storage != Storage::Float32)
+        {
+            quantizedTransitions.saveBinary(zfile);
+            hss2es.saveBinary(zfile);
+            zfile.write(smoothingFactor);
+            return;
+        }
+
         hss2hs.saveBinary(zfile);
         hss2es.saveBinary(zfile);
+
+        zfile.write(smoothingFactor);
+        zfile.write(counts.transitions);
+        zfile.write(counts.emissions);
     }
 
     bool loadBinary(ZLibFile& zfile)
     {
-        return hss2hs.loadBinary(zfile)
-            && hss2es.loadBinary(zfile);
+        uint8_t storageByte = 0;
+        if (!zfile.read(storageByte) || !validStorage(storageByte))
+        {
+            return false;
+        }
+
+        storage = Storage(storageByte);
+
+        if (storage != Storage::Float32)
+        {
+            hss2hs.resize(0, {0, 0});
+            if (!quantizedTransitions.loadBinary(zfile)
+                || quantizedTransitions.getStorage() != storage
+                || !hss2es.loadBinary(zfile)
+                || hss2es.getStorage() != storage
+                || quantizedTransitions.size() != size_t(hss2es.numHiddenStates()) * hss2es.numHiddenStates())
+            {
+                return false;
+            }
+
+            counts = Counts(numHiddenStates());
+            dirtyTransitions.assign(numHiddenStates(), false);
+            dirtyEmissions.assign(numHiddenStates(), false);
+            rebuildEmissions = false;
+
+            return zfile.read(smoothingFactor);
+        }
+
+        if (!hss2hs.loadBinary(zfile)
+            || !hss2es.loadBinary(zfile)
+            || hss2es.numHiddenStates() != hss2hs.sizeAt(0))
+        {
+            return false;
+        }
+
+        counts = Counts(numHiddenStates());
+        dirtyTransitions.assign(numHiddenStates(), false);
+        dirtyEmissions.assign(numHiddenStates(), false);
+        rebuildEmissions = false;
+
+        return zfile.read(smoothingFactor)
+            && zfile.read(counts.transitions)
+            && zfile.read(counts.emissions);
     }
 };
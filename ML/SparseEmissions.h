@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+
+#include "../Math/Quantized.h"
+#include "../ZLibFile/ZLibFile.h"
+
+#include "spdlog/spdlog.h"
+
+// Log probabilities of emissions per hidden state stored by emission in CSR form,
+// only observed (hidden state, emission) pairs are kept, the rest gets the smoothed default of the hidden state.
+template<typename N, typename HS, typename ES>
+class SparseEmissions
+{
+    HS hsNum = 0;
+    ES esNum = 0;
+
+    // Row of emission es is [offsets[es], offsets[es + 1]), sorted by hidden state
+    std::vector<uint32_t> offsets;
+    std::vector<HS> states;
+    std::vector<N> logProbs;
+    std::vector<N> defaults;
+
+    // Replaces logProbs once quantized, rows are emissions
+    Storage storage = Storage::Float32;
+    QuantizedRows<N> quantized;
+
+    N value(ES es, uint32_t i) const
+    {
+        return storage == Storage::Float32 ? logProbs[i] : quantized.at(es, i - offsets[es]);
+    }
+
+public:
+    bool operator==(const SparseEmissions<N, HS, ES>& other) const
+    {
+        return hsNum == other.hsNum
+            && esNum == other.esNum
+            && offsets == other.offsets
+            && states == other.states
+            && logProbs == other.logProbs
+            && defaults == other.defaults
+            && storage == other.storage
+            && (storage == Storage::Float32 || quantized == other.quantized);
+    }
+
+    void resize(HS hiddenStates, ES emissions)
+    {
+        hsNum = hiddenStates;
+        esNum = emissions;
+
+        offsets.assign(size_t(esNum) + 1, 0);
+        states.clear();
+        logProbs.clear();
+        defaults.assign(hsNum, 0);
+        storage = Storage::Float32;
+    }
+
+    HS numHiddenStates() const
+    {
+        return hsNum;
+    }
+
+    ES numEmissions() const
+    {
+        return esNum;
+    }
+
+    size_t nonZeros() const
+    {
+        return states.size();
+    }
+
+    Storage getStorage() const
+    {
+        return storage;
+    }
+
+    // Bytes taken by the layout and the log probabilities
+    size_t bytes() const
+    {
+        return offsets.size() * sizeof(uint32_t)
+            + states.size() * sizeof(HS)
+            + defaults.size() * sizeof(N)
+            + (storage == Storage::Float32 ? logProbs.size() * sizeof(N) : quantized.bytes());
+    }
+
+    // Observed log probabilities are stored in fewer bits, the model can not be renormalized afterwards
+    void quantize(Storage target)
+    {
+        if (target == Storage::Float32 || storage != Storage::Float32)
+        {
+            return;
+        }
+
+        quantized.encode(target, logProbs.data(), offsets);
+        storage = quantized.getStorage();
+
+        logProbs.clear();
+        logProbs.shrink_to_fit();
+    }
+
+    // Same smoothing as Tensor::normalizeLog over the emissions of every hidden state,
+    // counts are keyed by es * hiddenStates + hs.
+    void normalize(const std::unordered_map<uint64_t, uint32_t>& counts, N smoothingFactor)
+    {
+        std::vector<uint64_t> keys;
+        keys.reserve(counts.size());
+        for (const auto& [k, c]: counts)
+        {
+            keys.push_back(k);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        offsets.assign(size_t(esNum) + 1, 0);
+        states.resize(keys.size());
+        logProbs.resize(keys.size());
+        storage = Storage::Float32;
+
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            ++offsets[keys[i] / hsNum + 1];
+            states[i] = keys[i] % hsNum;
+        }
+
+        for (size_t es = 0; es < esNum; ++es)
+        {
+            offsets[es + 1] += offsets[es];
+        }
+
+        spdlog::debug("Sparse emissions {} of {}", keys.size(), uint64_t(hsNum) * esNum);
+
+        renormalize(counts, smoothingFactor, std::vector<bool>(hsNum, true));
+    }
+
+    // Recomputes hidden states marked as dirty, the set of observed pairs should not change since normalize.
+    // Sums are exact in double, so the result does not depend on the order of counts.
+    void renormalize(const std::unordered_map<uint64_t, uint32_t>& counts, N smoothingFactor, const std::vector<bool>& dirty)
+    {
+        std::vector<double> totals(hsNum, 0);
+        for (const auto& [k, c]: counts)
+        {
+            if (dirty[k % hsNum])
+            {
+                totals[k % hsNum] += c;
+            }
+        }
+
+        std::vector<N> sums(hsNum, 0);
+        for (HS hs = 0; hs < hsNum; ++hs)
+        {
+            if (dirty[hs])
+            {
+                sums[hs] = std::log(N(totals[hs]) + smoothingFactor * esNum);
+                defaults[hs] = std::log(smoothingFactor) - sums[hs];
+            }
+        }
+
+        for (ES es = 0; es < esNum; ++es)
+        {
+            for (uint32_t i = offsets[es]; i < offsets[es + 1]; ++i)
+            {
+                const HS hs = states[i];
+                if (dirty[hs])
+                {
+                    logProbs[i] = std::log(N(counts.at(uint64_t(es) * hsNum + hs)) + smoothingFactor) - sums[hs];
+                }
+            }
+        }
+    }
+
+    N at(HS hs, ES es) const
+    {
+        if (es >= esNum)
+        {
+            return defaults[hs];
+        }
+
+        const auto begin = states.begin() + offsets[es];
+        const auto end = states.begin() + offsets[es + 1];
+        const auto it = std::lower_bound(begin, end, hs);
+
+        return it != end && *it == hs ? value(es, it - states.begin()) : defaults[hs];
+    }
+
+    // Dense log probabilities of es for all hidden states
+    void fill(ES es, N* row) const
+    {
+        std::copy(defaults.begin(), defaults.end(), row);
+
+        if (es >= esNum)
+        {
+            return;
+        }
+
+        if (storage != Storage::Float32)
+        {
+            for (uint32_t i = offsets[es]; i < offsets[es + 1]; ++i)
+            {
+                row[states[i]] = quantized.at(es, i - offsets[es]);
+            }
+            return;
+        }
+
+        for (uint32_t i = offsets[es]; i < offsets[es + 1]; ++i)
+        {
+            row[states[i]] = logProbs[i];
+        }
+    }
+
+    void saveBinary(ZLibFile& zfile) const
+    {
+        zfile.write(hsNum);
+        zfile.write(esNum);
+        zfile.write(uint8_t(storage));
+        zfile.write(offsets);
+        zfile.write(states);
+        if (storage == Storage::Float32)
+        {
+            zfile.write(logProbs);
+        }
+        else
+        {
+            quantized.saveBinary(zfile);
+        }
+        zfile.write(defaults);
+    }
+
+    bool loadBinary(ZLibFile& zfile)
+    {
+        uint8_t storageByte = 0;
+        if (!zfile.read(hsNum)
+            || !zfile.read(esNum)
+            || !zfile.read(storageByte)
+            || !validStorage(storageByte)
+            || !zfile.read(offsets)
+            || !zfile.read(states))
+        {
+            return false;
+        }
+
+        storage = Storage(storageByte);
+        logProbs.clear();
+
+        const bool valuesRead = storage == Storage::Float32
+            ? zfile.read(logProbs) && logProbs.size() == states.size()
+            : quantized.loadBinary(zfile) && quantized.getStorage() == storage && quantized.size() == states.size();
+
+        return valuesRead
+            && zfile.read(defaults)
+            && offsets.size() == size_t(esNum) + 1
+            && offsets.back() == states.size()
+            && defaults.size() == hsNum;
+    }
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "HMM.h"
+#include "../Math/MaxPlus.h"
+
+// Online Viterbi over an unbounded stream of emissions. Hidden states are emitted as soon as all surviving paths
+// pass through the same state, so they are those predict would give for the whole sequence.
+// If paths do not converge within maxLatency positions the oldest one is taken from the currently best path.
+template<typename N, typename HS, typename ES>
+class StreamingViterbi
+{
+public:
+    typedef typename HMM<N, HS, ES>::States States;
+
+    static constexpr size_t defaultMaxLatency = 256;
+
+private:
+    // Scores are shifted back to zero when they fall that low, to keep float resolution on long streams
+    static constexpr N rescaleThreshold = -1e4;
+
+    const HMM<N, HS, ES>& hmm;
+    const HS serviceTag;
+    const HS hsNum;
+    const size_t maxLatency;
+
+    std::vector<N> prob;
+    std::vector<N> next;
+    std::vector<N> emissionScores;
+    std::vector<N> transitions;
+
+    // Ring of back pointers, row of pending position p is (first + p) % maxLatency
+    std::vector<HS> backPointers;
+    size_t first = 0;
+    size_t pending = 0;
+    bool started = false;
+
+    // Distinct states of the paths walked back, marked with the current stamp
+    std::vector<HS> frontier;
+    std::vector<HS> previous;
+    std::vector<uint32_t> marks;
+    uint32_t stamp = 0;
+
+    const HS* row(size_t p) const
+    {
+        return &backPointers[((first + p) % maxLatency) * hsNum];
+    }
+
+    // Appends states of pending positions [0, last] ending in hs and drops them,
+    // only the first limit of them if there are more, the others stay pending
+    void emit(size_t last, HS hs, size_t limit, std::vector<HS>& out)
+    {
+        if (limit == 0)
+        {
+            return;
+        }
+        for (; last >= limit; --last)
+        {
+            hs = row(last)[hs];
+        }
+
+        const size_t size = out.size();
+        out.resize(size + last + 1);
+        for (size_t p = last + 1; p != 0; --p)
+        {
+            out[size + p - 1] = hs;
+            hs = row(p - 1)[hs];
+        }
+
+        first = (first + last + 1) % maxLatency;
+        pending -= last + 1;
+    }
+
+    HS best() const
+    {
+        return std::max_element(prob.begin(), prob.end()) - prob.begin();
+    }
+
+    void nextStamp()
+    {
+        if (++stamp == 0)
+        {
+            std::fill(marks.begin(), marks.end(), 0);
+            stamp = 1;
+        }
+    }
+
+    // Walks all surviving paths back until they meet, then emits up to limit positions before the meeting point
+    void emitConverged(size_t limit, std::vector<HS>& out)
+    {
+        frontier.clear();
+        for (HS hs = 0; hs < hsNum; ++hs)
+        {
+            if (prob[hs] != -std::numeric_limits<N>::infinity())
+            {
+                frontier.push_back(hs);
+            }
+        }
+
+        if (frontier.size() == 1)
+        {
+            emit(pending - 1, frontier[0], limit, out);
+            return;
+        }
+
+        for (size_t p = pending - 1; p != 0 && !frontier.empty(); --p)
+        {
+            nextStamp();
+            previous.clear();
+
+            const HS* bp = row(p);
+            for (const HS hs: frontier)
+            {
+                const HS prev = bp[hs];
+                if (marks[prev] != stamp)
+                {
+                    marks[prev] = stamp;
+                    previous.push_back(prev);
+                }
+            }
+
+            if (previous.size() == 1)
+            {
+                emit(p - 1, previous[0], limit, out);
+                return;
+            }
+
+            frontier.swap(previous);
+        }
+    }
+
+public:
+    StreamingViterbi(const HMM<N, HS, ES>& hmm, HS serviceTag, size_t maxLatency = defaultMaxLatency)
+        : hmm(hmm)
+        , serviceTag(serviceTag)
+        , hsNum(hmm.numHiddenStates())
+        , maxLatency(std::max<size_t>(maxLatency, 1))
+        , prob(hsNum)
+        , next(hsNum)
+        , emissionScores(hsNum)
+        , backPointers(this->maxLatency * hsNum, 0)
+        , marks(hsNum, 0)
+    {
+        frontier.reserve(hsNum);
+        previous.reserve(hsNum);
+    }
+
+    // Positions decoded but not emitted yet, at most maxLatency
+    size_t size() const
+    {
+        return pending;
+    }
+
+    // Drops pending positions, the next emission starts a new sequence
+    void reset()
+    {
+        first = 0;
+        pending = 0;
+        started = false;
+    }
+
+    // Decodes the next emission restricted to the allowed states (all if null or empty),
+    // hidden states decided by it are appended to out, at most maxLatency of them.
+    void push(ES es, const States* allowed, std::vector<HS>& out)
+    {
+        // Decided positions beyond it wait for the next push
+        size_t limit = maxLatency;
+        if (pending == maxLatency)
+        {
+            --limit;
+
+            // Paths did not converge in time, the oldest position follows the best path
+            HS hs = best();
+            for (size_t p = pending - 1; p != 0; --p)
+            {
+                hs = row(p)[hs];
+            }
+            emit(0, hs, 1, out);
+        }
+
+        const bool restricted = allowed && !allowed->empty();
+
+        hmm.emissionRow(es, emissionScores.data());
+        std::fill(next.begin(), next.end(), -std::numeric_limits<N>::infinity());
+
+        HS* bp = &backPointers[((first + pending) % maxLatency) * hsNum];
+        const States& all = hmm.allStates(hsNum);
+        for (const HS hsTo: restricted ? *allowed : all)
+        {
+            if (!started)
+            {
+                next[hsTo] = hmm.transition(serviceTag, hsTo) + emissionScores[hsTo];
+                bp[hsTo] = 0;
+                continue;
+            }
+
+            bp[hsTo] = maxPlus(prob.data(), hmm.gatherTransitions(all, hsTo, transitions), emissionScores[hsTo], hsNum, next[hsTo]);
+        }
+
+        prob.swap(next);
+        started = true;
+        ++pending;
+
+        const N top = prob[best()];
+        if (top < rescaleThreshold && top != -std::numeric_limits<N>::infinity())
+        {
+            for (auto& p: prob)
+            {
+                p -= top;
+            }
+        }
+
+        emitConverged(limit, out);
+    }
+
+    // Ends the sequence as predict does, appends the remaining hidden states
+    void flush(std::vector<HS>& out)
+    {
+        if (pending != 0)
+        {
+            N pMax = -std::numeric_limits<N>::infinity();
+            const HS hs = maxPlus(prob.data(), hmm.gatherTransitions(hmm.allStates(hsNum), serviceTag, transitions), N(0), hsNum, pMax);
+            emit(pending - 1, pMax == -std::numeric_limits<N>::infinity() ? serviceTag : hs, pending, out);
+        }
+
+        reset();
+    }
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../Math/LRUCache.h"
+#include "../ZLibFile/ZLibFile.h"
+
+#include "spdlog/spdlog.h"
+
+// Hidden states of unknown words guessed by their suffixes, TnT style:
+// P(t | l[n-i+1..n]) = (P'(t | l[n-i+1..n]) + theta * P(t | l[n-i+2..n])) / (1 + theta),
+// theta is the standard deviation of the unconditioned hidden state probabilities.
+// Suffixes are counted in UTF-8 code points, the trie is built over bytes of reversed words.
+template<typename N, typename HS>
+class SuffixTrie
+{
+public:
+    static constexpr size_t maxSuffixLength = 10;
+    static constexpr size_t cacheCapacity = 4096;
+
+    // Candidate states sorted with log(P(t | suffix) / P(t)) scores, proportional to emission probabilities
+    struct Estimate
+    {
+        std::vector<HS> states;
+        std::vector<N> scores;
+    };
+
+private:
+    struct Node
+    {
+        std::vector<std::pair<uint8_t, uint32_t>> children;
+        // Only nodes ending on a code point boundary have counts
+        std::vector<std::pair<HS, uint32_t>> counts;
+        uint32_t total = 0;
+    };
+
+    std::vector<Node> nodes;
+    N theta = 0;
+
+    mutable std::mutex cacheMutex;
+    mutable LRUCache<std::string, Estimate> cache;
+
+    static bool codePointStart(uint8_t c)
+    {
+        return (c & 0xC0) != 0x80;
+    }
+
+    std::optional<uint32_t> child(uint32_t node, uint8_t c) const
+    {
+        const auto& children = nodes[node].children;
+        const auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(c, uint32_t(0)));
+        if (it == children.end() || it->first != c)
+        {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    uint32_t addChild(uint32_t node, uint8_t c)
+    {
+        if (const auto existing = child(node, c))
+        {
+            return *existing;
+        }
+
+        const uint32_t id = nodes.size();
+        nodes.emplace_back();
+
+        auto& children = nodes[node].children;
+        children.insert(std::lower_bound(children.begin(), children.end(), std::make_pair(c, uint32_t(0))), {c, id});
+
+        return id;
+    }
+
+    void count(uint32_t node, HS hs)
+    {
+        auto& counts = nodes[node].counts;
+        auto it = std::lower_bound(counts.begin(), counts.end(), std::make_pair(hs, uint32_t(0)));
+        if (it == counts.end() || it->first != hs)
+        {
+            it = counts.insert(it, {hs, 0});
+        }
+        ++it->second;
+        ++nodes[node].total;
+    }
+
+    N probability(uint32_t node, HS hs) const
+    {
+        const auto& counts = nodes[node].counts;
+        const auto it = std::lower_bound(counts.begin(), counts.end(), std::make_pair(hs, uint32_t(0)));
+        return it == counts.end() || it->first != hs ? N(0) : N(it->second) / nodes[node].total;
+    }
+
+public:
+    SuffixTrie()
+        : cache(cacheCapacity)
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        nodes.assign(1, Node());
+        theta = 0;
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cache.clear();
+    }
+
+    // Estimates are not swapped, both caches are cleared
+    void swap(SuffixTrie<N, HS>& other)
+    {
+        nodes.swap(other.nodes);
+        std::swap(theta, other.theta);
+
+        std::scoped_lock lock(cacheMutex, other.cacheMutex);
+        cache.clear();
+        other.cache.clear();
+    }
+
+    bool operator==(const SuffixTrie<N, HS>& other) const
+    {
+        if (nodes.size() != other.nodes.size() || theta != other.theta)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (nodes[i].children != other.nodes[i].children
+                || nodes[i].counts != other.nodes[i].counts
+                || nodes[i].total != other.nodes[i].total)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    size_t size() const
+    {
+        return nodes.size();
+    }
+
+    void add(const std::string& word, HS hs)
+    {
+        uint32_t node = 0;
+        count(node, hs);
+
+        size_t codePoints = 0;
+        for (size_t i = word.size(); i != 0 && codePoints < maxSuffixLength; --i)
+        {
+            const uint8_t c = word[i - 1];
+            node = addChild(node, c);
+
+            if (codePointStart(c))
+            {
+                ++codePoints;
+                count(node, hs);
+            }
+        }
+    }
+
+    // Should be called after adding words
+    void finalize()
+    {
+        const auto& root = nodes[0];
+        const size_t s = root.counts.size();
+
+        theta = 0;
+        if (s > 1)
+        {
+            const double mean = 1.0 / s;
+            double sum = 0;
+            for (const auto& [hs, c]: root.counts)
+            {
+                const double p = double(c) / root.total;
+                sum += (p - mean) * (p - mean);
+            }
+            theta = std::sqrt(sum / (s - 1));
+        }
+
+        spdlog::debug("Suffix trie of {} nodes, theta {}", nodes.size(), theta);
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cache.clear();
+    }
+
+    // Empty estimate if nothing was added
+    Estimate estimate(const std::string& word) const
+    {
+        // Boundary nodes of the longest known suffix, from the root
+        std::vector<uint32_t> chain(1, 0);
+        size_t matched = 0;
+
+        uint32_t node = 0;
+        size_t codePoints = 0;
+        for (size_t i = word.size(); i != 0 && codePoints < maxSuffixLength; --i)
+        {
+            const uint8_t c = word[i - 1];
+            const auto next = child(node, c);
+            if (!next)
+            {
+                break;
+            }
+
+            node = *next;
+            if (codePointStart(c))
+            {
+                ++codePoints;
+                chain.push_back(node);
+                matched = word.size() - i + 1;
+            }
+        }
+
+        const std::string suffix = word.substr(word.size() - matched);
+
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (auto cached = cache.get(suffix))
+            {
+                return *cached;
+            }
+        }
+
+        Estimate res;
+        for (const auto& [hs, c]: nodes[chain.back()].counts)
+        {
+            const N prior = probability(0, hs);
+
+            N p = prior;
+            for (size_t i = 1; i < chain.size(); ++i)
+            {
+                p = (probability(chain[i], hs) + theta * p) / (1 + theta);
+            }
+
+            res.states.push_back(hs);
+            res.scores.push_back(std::log(p) - std::log(prior));
+        }
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cache.put(suffix, res);
+
+        return res;
+    }
+
+    void saveBinary(ZLibFile& zfile) const
+    {
+        zfile.write(uint64_t(nodes.size()));
+        for (const auto& node: nodes)
+        {
+            zfile.write(node.children);
+            zfile.write(node.counts);
+            zfile.write(node.total);
+        }
+    }
+
+    bool loadBinary(ZLibFile& zfile)
+    {
+        uint64_t size = 0;
+        if (!zfile.read(size) || size == 0)
+        {
+            return false;
+        }
+
+        nodes.resize(size);
+        for (auto& node: nodes)
+        {
+            if (!zfile.read(node.children) || !zfile.read(node.counts) || !zfile.read(node.total))
+            {
+                return false;
+            }
+        }
+
+        finalize();
+
+        return true;
+    }
+};
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+
+#include "HMM.h"
+#include "../Math/Tensor.h"
+#include "../Math/FixedHeap.h"
+#include "../ZLibFile/ZLibFile.h"
+
+#include "spdlog/spdlog.h"
+
+// Second order transitions for HMM, emissions are taken from the first order HMM trained on the same data.
+// P(hs0 | hs2, hs1) = l1 * P(hs0) + l2 * P(hs0 | hs1) + l3 * P(hs0 | hs2, hs1), TnT style.
+// Only observed trigrams are stored, the rest falls back to the dense unigram/bigram part.
+template<typename N, typename HS, typename ES>
+class TrigramHMM
+{
+public:
+    typedef std::vector<HS> States;
+
+    static constexpr size_t defaultBeamWidth = 64;
+
+    // Raw trigram counts keyed by (hs2 * hsNum + hs1) * hsNum + hs0, can be filled independently and merged
+    class Counts
+    {
+        friend class TrigramHMM<N, HS, ES>;
+
+        HS hsNum = 0;
+        std::unordered_map<uint64_t, uint32_t> trigrams;
+
+    public:
+        Counts(HS hiddenStates = 0)
+            : hsNum(hiddenStates)
+        {
+        }
+
+        // Keys depend on the number of hidden states
+        void resize(HS hiddenStates)
+        {
+            std::unordered_map<uint64_t, uint32_t> old;
+            old.swap(trigrams);
+
+            for (const auto& [k, c]: old)
+            {
+                const uint64_t hs0 = k % hsNum;
+                const uint64_t hs1 = (k / hsNum) % hsNum;
+                const uint64_t hs2 = k / hsNum / hsNum;
+                trigrams[(hs2 * hiddenStates + hs1) * hiddenStates + hs0] = c;
+            }
+
+            hsNum = hiddenStates;
+        }
+
+        void addHiddenStates(HS hs2, HS hs1, HS hs0)
+        {
+            ++trigrams[(uint64_t(hs2) * hsNum + hs1) * hsNum + hs0];
+        }
+
+        void merge(const Counts& other)
+        {
+            for (const auto& [k, c]: other.trigrams)
+            {
+                trigrams[k] += c;
+            }
+        }
+    };
+
+private:
+    // Kept after normalization, so new data can be added later
+    Counts counts;
+    double smoothingFactor = 0;
+
+    Tensor<N, HS, 2> backoff;
+    std::unordered_map<uint64_t, N> trigrams;
+
+    uint64_t key(HS hs2, HS hs1, HS hs0) const
+    {
+        const uint64_t hsNum = backoff.sizeAt(0);
+        return (uint64_t(hs2) * hsNum + hs1) * hsNum + hs0;
+    }
+
+    struct Hypothesis
+    {
+        N score;
+        HS hs1;
+        HS hs0;
+        uint32_t back;
+
+        bool operator<(const Hypothesis& other) const
+        {
+            return score < other.score;
+        }
+    };
+
+    std::vector<HS> beam(const HMM<N, HS, ES>& hmm, HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>* allowed, const typename HMM<N, HS, ES>::EmissionOverrides* overrides, size_t beamWidth) const
+    {
+        if (emissions.empty())
+        {
+            spdlog::debug("No input provided");
+            return std::vector<HS>();
+        }
+
+        const size_t seqSize = emissions.size();
+        const size_t width = beamWidth == 0 ? defaultBeamWidth : beamWidth;
+
+        States all(backoff.sizeAt(0));
+        std::iota(all.begin(), all.end(), HS(0));
+
+        auto allowedStates = [&](size_t i) -> const States&
+        {
+            const bool restricted = allowed && !(*allowed)[i].empty();
+            return restricted ? (*allowed)[i] : all;
+        };
+
+        // Position i keeps sizes[i] best (hs1, hs0) pairs in [i * width, i * width + sizes[i])
+        std::vector<Hypothesis> hyps(seqSize * width);
+        std::vector<size_t> sizes(seqSize, 0);
+        FixedHeap<Hypothesis> heap(width);
+        std::vector<N> emissionScores(all.size());
+
+        auto storeBeam = [&](size_t i)
+        {
+            auto begin = hyps.begin() + i * width;
+            auto end = std::copy(heap.begin(), heap.end(), begin);
+            // Grouped by the last state, so hypotheses sharing it are expanded together
+            std::sort(begin, end, [](const auto& a, const auto& b) { return a.hs0 < b.hs0 || (a.hs0 == b.hs0 && a.hs1 < b.hs1); });
+            sizes[i] = heap.size();
+            heap.clear();
+        };
+
+        hmm.emissionRow(emissions, overrides, 0, emissionScores.data());
+        for (const HS hs0: allowedStates(0))
+        {
+            heap.push({transition(serviceTag, serviceTag, hs0) + emissionScores[hs0], serviceTag, hs0, 0});
+        }
+        storeBeam(0);
+
+        for (size_t i = 1; i < seqSize; ++i)
+        {
+            const size_t from = (i - 1) * width;
+            const size_t fromEnd = from + sizes[i - 1];
+
+            hmm.emissionRow(emissions, overrides, i, emissionScores.data());
+
+            for (size_t groupBegin = from; groupBegin < fromEnd;)
+            {
+                const HS hs1 = hyps[groupBegin].hs0;
+                size_t groupEnd = groupBegin;
+                while (groupEnd < fromEnd && hyps[groupEnd].hs0 == hs1)
+                {
+                    ++groupEnd;
+                }
+
+                for (const HS hs0: allowedStates(i))
+                {
+                    N best = -std::numeric_limits<N>::infinity();
+                    size_t bestIx = groupBegin;
+                    for (size_t h = groupBegin; h < groupEnd; ++h)
+                    {
+                        N p = hyps[h].score + transition(hyps[h].hs1, hs1, hs0);
+                        if (p > best)
+                        {
+                            best = p;
+                            bestIx = h;
+                        }
+                    }
+
+                    heap.push({best + emissionScores[hs0], hs1, hs0, uint32_t(bestIx - from)});
+                }
+
+                groupBegin = groupEnd;
+            }
+            storeBeam(i);
+        }
+
+        const size_t last = (seqSize - 1) * width;
+        N pMax = -std::numeric_limits<N>::infinity();
+        size_t ix = 0;
+        for (size_t h = 0; h < sizes[seqSize - 1]; ++h)
+        {
+            N p = hyps[last + h].score + transition(hyps[last + h].hs1, hyps[last + h].hs0, serviceTag);
+            if (p > pMax)
+            {
+                pMax = p;
+                ix = h;
+            }
+        }
+
+        std::vector<HS> res(seqSize);
+        for (size_t i = seqSize; i != 0; --i)
+        {
+            const Hypothesis& h = hyps[(i - 1) * width + ix];
+            res[i - 1] = h.hs0;
+            ix = h.back;
+        }
+
+        return res;
+    }
+
+public:
+    TrigramHMM()
+        : backoff()
+    {
+    }
+
+    void swap(TrigramHMM<N, HS, ES>& other)
+    {
+        std::swap(counts, other.counts);
+        std::swap(smoothingFactor, other.smoothingFactor);
+        backoff.swap(other.backoff);
+        trigrams.swap(other.trigrams);
+    }
+
+    bool operator==(const TrigramHMM<N, HS, ES>& other) const
+    {
+        return backoff == other.backoff && trigrams == other.trigrams;
+    }
+
+    HS numHiddenStates() const
+    {
+        return backoff.sizeAt(0);
+    }
+
+    void resize(HS hiddenStates)
+    {
+        spdlog::debug("Resize trigram HMM {}", hiddenStates);
+        counts = Counts(hiddenStates);
+        trigrams.clear();
+        backoff.resize(0, {hiddenStates, hiddenStates});
+    }
+
+    // Keeps counts, the model has to be renormalized afterwards
+    void grow(HS hiddenStates)
+    {
+        if (hiddenStates == backoff.sizeAt(0))
+        {
+            return;
+        }
+
+        spdlog::debug("Grow trigram HMM {}", hiddenStates);
+        counts.resize(hiddenStates);
+        trigrams.clear();
+        backoff.resize(0, {hiddenStates, hiddenStates});
+    }
+
+    void addHiddenStates(HS hs2, HS hs1, HS hs0)
+    {
+        counts.addHiddenStates(hs2, hs1, hs0);
+    }
+
+    // Counts are integers and all sums in normalize are exact, so the result does not depend on the order of merges
+    void merge(const Counts& other)
+    {
+        counts.merge(other);
+    }
+
+    N transition(HS hs2, HS hs1, HS hs0) const
+    {
+        const auto it = trigrams.find(key(hs2, hs1, hs0));
+        return it == trigrams.end() ? backoff.at(hs1, hs0) : it->second;
+    }
+
+    // Interpolation weights are global, so everything is recalculated from the counts every time
+    void renormalize()
+    {
+        normalize(smoothingFactor);
+    }
+
+    void normalize(double smoothingFactor)
+    {
+        spdlog::debug("Normalizing trigram HMM {}", smoothingFactor);
+
+        this->smoothingFactor = smoothingFactor;
+
+        const HS hsNum = backoff.sizeAt(0);
+        const uint64_t hsNum2 = uint64_t(hsNum) * hsNum;
+
+        // Lower order counts are marginals of the trigram ones
+        std::vector<double> unigrams(hsNum, 0);
+        std::vector<double> contexts1(hsNum, 0);
+        std::vector<double> bigrams(hsNum2, 0);
+        std::unordered_map<uint64_t, double> contexts2;
+        double total = 0;
+
+        for (const auto& [k, c]: counts.trigrams)
+        {
+            const HS hs0 = k % hsNum;
+            const HS hs1 = (k / hsNum) % hsNum;
+
+            unigrams[hs0] += c;
+            contexts1[hs1] += c;
+            bigrams[uint64_t(hs1) * hsNum + hs0] += c;
+            contexts2[k / hsNum] += c;
+            total += c;
+        }
+
+        // Deleted interpolation
+        double lambdas[3] = {0, 0, 0};
+        for (const auto& [k, c]: counts.trigrams)
+        {
+            const HS hs0 = k % hsNum;
+            const HS hs1 = (k / hsNum) % hsNum;
+
+            const double c2 = contexts2[k / hsNum];
+            const double b = bigrams[uint64_t(hs1) * hsNum + hs0];
+
+            const double r3 = c2 > 1 ? (c - 1) / (c2 - 1) : 0;
+            const double r2 = contexts1[hs1] > 1 ? (b - 1) / (contexts1[hs1] - 1) : 0;
+            const double r1 = total > 1 ? (unigrams[hs0] - 1) / (total - 1) : 0;
+
+            lambdas[r3 >= r2 && r3 >= r1 ? 2 : (r2 >= r1 ? 1 : 0)] += c;
+        }
+
+        // Smoothed as well, so no order is switched off completely
+        const double lambdasSum = lambdas[0] + lambdas[1] + lambdas[2] + 3 * smoothingFactor;
+        for (auto& l: lambdas)
+        {
+            l = lambdasSum > 0 ? (l + smoothingFactor) / lambdasSum : 1.0 / 3;
+        }
+
+        spdlog::debug("Trigram HMM lambdas {} {} {}", lambdas[0], lambdas[1], lambdas[2]);
+
+        auto lowerOrder = [&](HS hs1, HS hs0)
+        {
+            const double p1 = (unigrams[hs0] + smoothingFactor) / (total + smoothingFactor * hsNum);
+            const double p2 = contexts1[hs1] > 0 ? bigrams[uint64_t(hs1) * hsNum + hs0] / contexts1[hs1] : 0;
+            return lambdas[0] * p1 + lambdas[1] * p2;
+        };
+
+        for (HS hs1 = 0; hs1 < hsNum; ++hs1)
+        {
+            for (HS hs0 = 0; hs0 < hsNum; ++hs0)
+            {
+                backoff.at(hs1, hs0) = std::log(lowerOrder(hs1, hs0));
+            }
+        }
+
+        trigrams.clear();
+        trigrams.reserve(counts.trigrams.size());
+        for (const auto& [k, c]: counts.trigrams)
+        {
+            const HS hs0 = k % hsNum;
+            const HS hs1 = (k / hsNum) % hsNum;
+            trigrams[k] = std::log(lowerOrder(hs1, hs0) + lambdas[2] * c / contexts2[k / hsNum]);
+        }
+    }
+
+    // Pruned second order Viterbi, keeps beamWidth best pairs of last two states at every position
+    std::vector<HS> predict(const HMM<N, HS, ES>& hmm, HS serviceTag, const std::vector<ES>& emissions, size_t beamWidth) const
+    {
+        spdlog::debug("Predicting by trigram HMM with beam {}", beamWidth);
+
+        return beam(hmm, serviceTag, emissions, nullptr, nullptr, beamWidth);
+    }
+
+    std::vector<HS> predict(const HMM<N, HS, ES>& hmm, HS serviceTag, const std::vector<ES>& emissions, const std::vector<States>& allowed, size_t beamWidth, const typename HMM<N, HS, ES>::EmissionOverrides* overrides = nullptr) const
+    {
+        spdlog::debug("Predicting by trigram HMM with beam {} and restricted states", beamWidth);
+
+        if (!hmm.validInput(emissions, allowed, overrides))
+        {
+            return std::vector<HS>();
+        }
+
+        return beam(hmm, serviceTag, emissions, &allowed, overrides, beamWidth);
+    }
+
+    void saveBinary(ZLibFile& zfile) const
+    {
+        backoff.saveBinary(zfile);
+        zfile.write(trigrams);
+
+        zfile.write(smoothingFactor);
+        zfile.write(counts.trigrams);
+    }
+
+    bool loadBinary(ZLibFile& zfile)
+    {
+        if (!backoff.loadBinary(zfile))
+        {
+            return false;
+        }
+
+        counts = Counts(backoff.sizeAt(0));
+        return zfile.read(trigrams)
+            && zfile.read(smoothingFactor)
+            && zfile.read(counts.trigrams);
+    }
+};
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <iostream>
+#include <utility>
 
 // http://e-maxx.ru/algo/dsu
 template<typename T>
@@ -94,3 +95,80 @@ public:
         }
     }
 };
+
+// Union by rank without path compression, so the latest unions can be undone
+template<typename T>
+class RollbackDSU
+{
+    std::vector<T> parent;
+    std::vector<T> rank;
+    // Joined root with the previous rank of the root it was joined to
+    std::vector<std::pair<T, T>> history;
+
+public:
+    RollbackDSU(T numElems)
+        : parent(numElems)
+        , rank(numElems, 0)
+    {
+        for (T e = 0; e < numElems; ++e)
+        {
+            parent[e] = e;
+        }
+    }
+
+    T size() const
+    {
+        return parent.size();
+    }
+
+    T find(T e) const
+    {
+        while (parent[e] != e)
+        {
+            e = parent[e];
+        }
+        return e;
+    }
+
+    // Returns false if both are in the same set already
+    bool makeUnion(T e1, T e2)
+    {
+        e1 = find(e1);
+        e2 = find(e2);
+        if (e1 == e2)
+        {
+            return false;
+        }
+
+        if (rank[e1] < rank[e2])
+        {
+            std::swap(e1, e2);
+        }
+
+        history.emplace_back(e2, rank[e1]);
+        parent[e2] = e1;
+        if (rank[e1] == rank[e2])
+        {
+            ++rank[e1];
+        }
+        return true;
+    }
+
+    // Number of unions made, for rollback
+    size_t time() const
+    {
+        return history.size();
+    }
+
+    // Undoes unions made after time
+    void rollback(size_t time)
+    {
+        while (history.size() > time)
+        {
+            const auto [e, r] = history.back();
+            history.pop_back();
+            rank[parent[e]] = r;
+            parent[e] = e;
+        }
+    }
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+// Keeps up to capacity greatest elements, storage is allocated once
+template<typename T, typename Compare = std::less<T>>
+class FixedHeap
+{
+    std::vector<T> heap;
+    size_t _capacity = 0;
+
+    // Min-heap by Compare, so the smallest kept element is on top
+    static bool greater(const T& a, const T& b)
+    {
+        return Compare()(b, a);
+    }
+
+public:
+    FixedHeap(size_t capacity)
+    {
+        reset(capacity);
+    }
+
+    void reset(size_t capacity)
+    {
+        _capacity = capacity;
+        heap.clear();
+        heap.reserve(capacity);
+    }
+
+    void clear()
+    {
+        heap.clear();
+    }
+
+    size_t size() const
+    {
+        return heap.size();
+    }
+
+    size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    bool empty() const
+    {
+        return heap.empty();
+    }
+
+    const T& top() const
+    {
+        return heap.front();
+    }
+
+    // Returns false if the element was not kept
+    bool push(const T& t)
+    {
+        if (heap.size() < _capacity)
+        {
+            heap.push_back(t);
+            std::push_heap(heap.begin(), heap.end(), greater);
+            return true;
+        }
+
+        if (_capacity == 0 || !Compare()(heap.front(), t))
+        {
+            return false;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        heap.back() = t;
+        std::push_heap(heap.begin(), heap.end(), greater);
+        return true;
+    }
+
+    typename std::vector<T>::const_iterator begin() const
+    {
+        return heap.begin();
+    }
+
+    typename std::vector<T>::const_iterator end() const
+    {
+        return heap.end();
+    }
+};
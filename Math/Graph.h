@@ -3,6 +3,7 @@
 #include <vector>
 #include <limits>
 #include <cmath>
+#include <algorithm>
 
 #include "Tensor.h"
 
@@ -11,7 +12,10 @@ class Graph
 {
 private:
     static constexpr W noEdge = NAN;
+    // Allocated for the largest graph, only the first vertices and labels are used
     Tensor<W, V, 3> tensor;
+    V vertices;
+    V labels;
 
 public:
     struct Edge
@@ -32,23 +36,51 @@ public:
 
     Graph(Vertex numVertices, Label numLabels)
         : tensor(noEdge, {numVertices, numVertices, numLabels})
+        , vertices(numVertices)
+        , labels(numLabels)
     {
     }
 
     Graph(Vertex numVertices, Label numLabels, const Edges& edges)
         : tensor(noEdge, {numVertices, numVertices, numLabels})
+        , vertices(numVertices)
+        , labels(numLabels)
     {
         std::for_each(edges.begin(), edges.end(), [&](const auto &e) { addEdge(e); });
     }
 
+    // Empty graph of the given size, memory is reallocated only if it grows beyond the largest one
+    void reset(Vertex numVertices, Label numLabels)
+    {
+        if (numVertices > tensor.sizeAt(0) || numLabels > tensor.sizeAt(2))
+        {
+            const V capacity = std::max(numVertices, tensor.sizeAt(0));
+            tensor.resize(noEdge, {capacity, capacity, std::max(numLabels, tensor.sizeAt(2))});
+            vertices = numVertices;
+            labels = numLabels;
+            return;
+        }
+
+        vertices = numVertices;
+        labels = numLabels;
+        for (Label l = 0; l < labels; ++l)
+        {
+            for (Vertex dest = 0; dest < vertices; ++dest)
+            {
+                W* column = &tensor.at(Vertex(0), dest, l);
+                std::fill(column, column + vertices, noEdge);
+            }
+        }
+    }
+
     Vertex numVertices() const
     {
-        return tensor.sizeAt(0);
+        return vertices;
     }
 
     Label numLabels() const
     {
-        return tensor.sizeAt(2);
+        return labels;
     }
 
     static bool isEdge(W w)
@@ -86,6 +118,39 @@ public:
         return tensor.at(src, dest, label);
     }
 
+    // Calls f(src, label, weight) for every edge into dest, by source and then by label
+    template<typename F>
+    void forEachIncoming(Vertex dest, F f) const
+    {
+        for (Vertex src = 0; src < vertices; ++src)
+        {
+            for (Label l = 0; l < labels; ++l)
+            {
+                const W& w = tensor.at(src, dest, l);
+                if (isEdge(w))
+                {
+                    f(src, l, w);
+                }
+            }
+        }
+    }
+
+    template<typename F>
+    void forEachIncoming(Vertex dest, F f)
+    {
+        for (Vertex src = 0; src < vertices; ++src)
+        {
+            for (Label l = 0; l < labels; ++l)
+            {
+                W& w = tensor.at(src, dest, l);
+                if (isEdge(w))
+                {
+                    f(src, l, w);
+                }
+            }
+        }
+    }
+
     Edges edges() const
     {
         Edges res;
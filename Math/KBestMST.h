@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <tuple>
+#include <cstdint>
+
+#include "spdlog/spdlog.h"
+
+#include "SparseGraph.h"
+#include "TarjanMST.h"
+
+// k best spanning trees by the partition of Lawler and Camerini et al.: the trees of a subproblem
+// are split by the edges of its best tree, the i-th part keeps the tree edges before the i-th one
+// and bans the i-th one. Parts are disjoint, so every tree is found once, best first.
+// Subproblems are solved by Tarjan on a sparse copy of the allowed edges, the graph is not changed.
+template<typename G>
+class KBestMST
+{
+    typedef G::Vertex Vertex;
+    typedef G::Label Label;
+    typedef G::Edge Edge;
+    typedef G::Weight Weight;
+
+    typedef G::Edges Edges;
+
+    typedef SparseGraph<Weight, Vertex> Constrained;
+
+public:
+    struct ScoredTree
+    {
+        Edges edges;
+        Weight score;
+    };
+
+private:
+    static constexpr uint32_t none = uint32_t(-1);
+
+    struct Subproblem
+    {
+        ScoredTree tree;
+        // Required edges keep their destinations, banned ones are sorted by byDest
+        Edges required;
+        Edges banned;
+
+        bool operator<(const Subproblem& other) const
+        {
+            return tree.score < other.tree.score;
+        }
+    };
+
+    const G& graph;
+
+    Constrained constrained = Constrained(0, 1);
+    TarjanMST<Constrained> tarjan {constrained};
+
+    std::vector<Subproblem> queue;
+    std::vector<uint32_t> requiredOf;
+
+    static bool byDest(const Edge& a, const Edge& b)
+    {
+        return std::tie(a.dest, a.src, a.label) < std::tie(b.dest, b.src, b.label);
+    }
+
+    std::optional<ScoredTree> solve(Vertex root, const Edges& required, const Edges& banned)
+    {
+        const Vertex n = graph.numVertices();
+
+        constrained.reset(n, graph.numLabels());
+        requiredOf.assign(n, none);
+        for (size_t i = 0; i < required.size(); ++i)
+        {
+            requiredOf[required[i].dest] = i;
+        }
+
+        for (Vertex dest = 0; dest < n; ++dest)
+        {
+            if (dest == root)
+            {
+                continue;
+            }
+
+            graph.forEachIncoming(dest, [&](Vertex src, Label l, const Weight& w)
+            {
+                if (requiredOf[dest] != none && (required[requiredOf[dest]].src != src || required[requiredOf[dest]].label != l))
+                {
+                    return;
+                }
+                if (std::binary_search(banned.begin(), banned.end(), Edge {src, dest, l, w}, byDest))
+                {
+                    return;
+                }
+                constrained.addEdge(src, dest, l, w);
+            });
+        }
+
+        auto edges = tarjan.getSpanningTree(root);
+        if (!edges)
+        {
+            return {};
+        }
+
+        Weight score = 0;
+        for (const auto& e: *edges)
+        {
+            score += e.weight;
+        }
+        return ScoredTree {std::move(*edges), score};
+    }
+
+    void push(Vertex root, Edges&& required, Edges&& banned)
+    {
+        auto tree = solve(root, required, banned);
+        if (tree)
+        {
+            queue.push_back(Subproblem {std::move(*tree), std::move(required), std::move(banned)});
+            std::push_heap(queue.begin(), queue.end());
+        }
+    }
+
+public:
+    KBestMST(const G& _graph)
+        : graph(_graph)
+    {
+    }
+
+    // Up to k best trees, best first, edges of every tree sorted by destination with their weights in the graph.
+    // Fewer trees are returned if there are not that many.
+    std::vector<ScoredTree> getSpanningTrees(Vertex root, size_t k)
+    {
+        spdlog::debug("Get {} best spanning trees, {} vertices, {} labels", k, graph.numVertices(), graph.numLabels());
+
+        std::vector<ScoredTree> res;
+        queue.clear();
+
+        if (k == 0)
+        {
+            return res;
+        }
+
+        push(root, {}, {});
+
+        while (!queue.empty() && res.size() < k)
+        {
+            std::pop_heap(queue.begin(), queue.end());
+            Subproblem best = std::move(queue.back());
+            queue.pop_back();
+
+            if (res.size() + 1 < k)
+            {
+                std::vector<bool> fixed(graph.numVertices(), false);
+                for (const auto& e: best.required)
+                {
+                    fixed[e.dest] = true;
+                }
+
+                Edges required = best.required;
+                for (const auto& e: best.tree.edges)
+                {
+                    if (fixed[e.dest])
+                    {
+                        continue;
+                    }
+
+                    Edges banned = best.banned;
+                    banned.insert(std::upper_bound(banned.begin(), banned.end(), e, byDest), e);
+                    push(root, Edges(required), std::move(banned));
+
+                    required.push_back(e);
+                }
+            }
+
+            res.push_back(std::move(best.tree));
+        }
+
+        spdlog::debug("Found {} trees, {} subproblems left", res.size(), queue.size());
+
+        return res;
+    }
+};
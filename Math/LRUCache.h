@@ -0,0 +1,77 @@
+#pragma once
+
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+// Keeps up to capacity most recently used values, not thread safe
+template<typename K, typename V>
+class LRUCache
+{
+    typedef std::list<std::pair<K, V>> Items;
+
+    Items items;
+    std::unordered_map<K, typename Items::iterator> index;
+    size_t _capacity = 0;
+
+public:
+    LRUCache(size_t capacity)
+        : _capacity(capacity)
+    {
+    }
+
+    size_t size() const
+    {
+        return items.size();
+    }
+
+    size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    void clear()
+    {
+        items.clear();
+        index.clear();
+    }
+
+    // Found value becomes the most recently used one
+    std::optional<V> get(const K& key)
+    {
+        const auto it = index.find(key);
+        if (it == index.end())
+        {
+            return std::nullopt;
+        }
+
+        items.splice(items.begin(), items, it->second);
+        return it->second->second;
+    }
+
+    void put(const K& key, const V& value)
+    {
+        const auto it = index.find(key);
+        if (it != index.end())
+        {
+            it->second->second = value;
+            items.splice(items.begin(), items, it->second);
+            return;
+        }
+
+        if (_capacity == 0)
+        {
+            return;
+        }
+
+        if (items.size() == _capacity)
+        {
+            index.erase(items.back().first);
+            items.pop_back();
+        }
+
+        items.emplace_front(key, value);
+        index[key] = items.begin();
+    }
+};
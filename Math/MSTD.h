@@ -39,27 +39,14 @@ class ChuLiuEdmondsMST
     {
         Edge maxEdge;
         bool found = false;
-        for (Vertex src = 0; src < graph.numVertices(); ++src)
+        graph.forEachIncoming(v, [&](Vertex src, Label l, const Weight& w)
         {
-            for (Label l = 0; l < graph.numLabels(); ++l)
+            if (w != 0 && w > maxEdge.weight)
             {
-                const Weight& w = graph.weight(src, v, l);
-                if (w == 0)
-                {
-                    continue;
-                }
-
-                if (graph.isEdge(w) && w > maxEdge.weight)
-                {
-                    maxEdge.weight = w;
-                    maxEdge.src = src;
-                    maxEdge.dest = v;
-                    maxEdge.label= l;
-
-                    found = true;
-                }
+                maxEdge = Edge {src, v, l, w};
+                found = true;
             }
-        }
+        });
         return found ? std::make_optional(maxEdge) : std::optional<Edge>();
     }
 
@@ -67,58 +54,28 @@ class ChuLiuEdmondsMST
     {
         Edge maxEdge;
         bool found = false;
-        for (Vertex src = 0; src < graph.numVertices(); ++src)
+        graph.forEachIncoming(v, [&](Vertex src, Label l, const Weight& w)
         {
-            if (src == alreadySrc)
-            {
-                continue;
-            }
-
-            for (Label l = 0; l < graph.numLabels(); ++l)
+            if (src != alreadySrc && w != 0 && w > maxEdge.weight)
             {
-                const Weight& w = graph.weight(src, v, l);
-                if (w == 0)
-                {
-                    continue;
-                }
-
-                if (graph.isEdge(w) && w > maxEdge.weight)
-                {
-                    maxEdge.weight = w;
-                    maxEdge.src = src;
-                    maxEdge.dest = v;
-                    maxEdge.label= l;
-
-                    found = true;
-                }
+                maxEdge = Edge {src, v, l, w};
+                found = true;
             }
-        }
+        });
         return found ? std::make_optional(maxEdge) : std::optional<Edge>();
     }
 
     void subtractWeightFromIncomingNodes(Vertex v, Weight w)
     {
-        for (Vertex src = 0; src < graph.numVertices(); ++src)
+        graph.forEachIncoming(v, [&](Vertex, Label, Weight& weight)
         {
-            for (Label l = 0; l < graph.numLabels(); ++l)
-            {
-                graph.weight(src, v, l) -= w;
-            }
-        }
+            weight -= w;
+        });
     }
 
     void removeEdges()
     {
-        for (Vertex dest = 0; dest < graph.numVertices(); ++dest)
-        {
-            for (Vertex src = 0; src < graph.numVertices(); ++src)
-            {
-                for (Label l = 0; l < graph.numLabels(); ++l)
-                {
-                    graph.removeEdge(src, dest, l);
-                }
-            }
-        }
+        graph.reset(graph.numVertices(), graph.numLabels());
     }
 
 public:
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <immintrin.h>
+
+enum class SIMDLevel
+{
+    Scalar,
+    AVX2,
+    AVX512,
+};
+
+inline SIMDLevel detectSIMDLevel()
+{
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return SIMDLevel::AVX512;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SIMDLevel::AVX2;
+    }
+
+    return SIMDLevel::Scalar;
+}
+
+inline SIMDLevel simdLevel()
+{
+    static const SIMDLevel level = detectSIMDLevel();
+    return level;
+}
+
+// Max-plus product of two vectors: res = max_j((a[j] + b[j]) + c), returns the first j reaching it
+template<typename N>
+size_t maxPlusScalar(const N* a, const N* b, N c, size_t n, N& res, size_t start = 0)
+{
+    size_t resIx = 0;
+    for (size_t j = start; j < n; ++j)
+    {
+        N p = a[j] + b[j] + c;
+        if (p > res)
+        {
+            res = p;
+            resIx = j;
+        }
+    }
+    return resIx;
+}
+
+inline size_t maxPlusReduce(const float* values, const int32_t* indexes, size_t lanes, const float* a, const float* b, float c, size_t start, size_t n, float& res)
+{
+    size_t resIx = 0;
+    res = -std::numeric_limits<float>::infinity();
+
+    for (size_t l = 0; l < lanes; ++l)
+    {
+        if (values[l] > res || (values[l] == res && size_t(indexes[l]) < resIx))
+        {
+            res = values[l];
+            resIx = indexes[l];
+        }
+    }
+
+    const float vectorRes = res;
+    const size_t tailIx = maxPlusScalar(a, b, c, n, res, start);
+
+    return res > vectorRes ? tailIx : resIx;
+}
+
+__attribute__((target("avx2")))
+inline size_t maxPlusAVX2(const float* a, const float* b, float c, size_t n, float& res)
+{
+    constexpr size_t lanes = 8;
+
+    const __m256 vc = _mm256_set1_ps(c);
+    const __m256i step = _mm256_set1_epi32(lanes);
+    __m256 best = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256i bestIx = _mm256_setzero_si256();
+    __m256i ix = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    size_t j = 0;
+    for (; j + lanes <= n; j += lanes)
+    {
+        __m256 p = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(a + j), _mm256_loadu_ps(b + j)), vc);
+        __m256 greater = _mm256_cmp_ps(p, best, _CMP_GT_OQ);
+        best = _mm256_blendv_ps(best, p, greater);
+        bestIx = _mm256_blendv_epi8(bestIx, ix, _mm256_castps_si256(greater));
+        ix = _mm256_add_epi32(ix, step);
+    }
+
+    alignas(32) float values[lanes];
+    alignas(32) int32_t indexes[lanes];
+    _mm256_store_ps(values, best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(indexes), bestIx);
+
+    return maxPlusReduce(values, indexes, lanes, a, b, c, j, n, res);
+}
+
+__attribute__((target("avx512f")))
+inline size_t maxPlusAVX512(const float* a, const float* b, float c, size_t n, float& res)
+{
+    constexpr size_t lanes = 16;
+
+    const __m512 vc = _mm512_set1_ps(c);
+    const __m512i step = _mm512_set1_epi32(lanes);
+    __m512 best = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    __m512i bestIx = _mm512_setzero_si512();
+    __m512i ix = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    size_t j = 0;
+    for (; j + lanes <= n; j += lanes)
+    {
+        __m512 p = _mm512_add_ps(_mm512_add_ps(_mm512_loadu_ps(a + j), _mm512_loadu_ps(b + j)), vc);
+        __mmask16 greater = _mm512_cmp_ps_mask(p, best, _CMP_GT_OQ);
+        best = _mm512_mask_blend_ps(greater, best, p);
+        bestIx = _mm512_mask_blend_epi32(greater, bestIx, ix);
+        ix = _mm512_add_epi32(ix, step);
+    }
+
+    alignas(64) float values[lanes];
+    alignas(64) int32_t indexes[lanes];
+    _mm512_store_ps(values, best);
+    _mm512_store_si512(indexes, bestIx);
+
+    return maxPlusReduce(values, indexes, lanes, a, b, c, j, n, res);
+}
+
+inline size_t maxPlus(SIMDLevel level, const float* a, const float* b, float c, size_t n, float& res)
+{
+    switch (level)
+    {
+        case SIMDLevel::AVX512:
+            return maxPlusAVX512(a, b, c, n, res);
+        case SIMDLevel::AVX2:
+            return maxPlusAVX2(a, b, c, n, res);
+        default:
+            res = -std::numeric_limits<float>::infinity();
+            return maxPlusScalar(a, b, c, n, res);
+    }
+}
+
+inline size_t maxPlus(const float* a, const float* b, float c, size_t n, float& res)
+{
+    return maxPlus(simdLevel(), a, b, c, n, res);
+}
+
+template<typename N>
+size_t maxPlus(const N* a, const N* b, N c, size_t n, N& res)
+{
+    res = -std::numeric_limits<N>::infinity();
+    return maxPlusScalar(a, b, c, n, res);
+}
+
+// Log-sum-exp counterpart: log(sum_j(exp((a[j] + b[j]) + c))), the maximum is found by the max-plus kernel
+template<typename N>
+N logSumExp(const N* a, const N* b, N c, size_t n)
+{
+    N max = 0;
+    maxPlus(a, b, c, n, max);
+
+    if (max == -std::numeric_limits<N>::infinity())
+    {
+        return max;
+    }
+
+    N sum = 0;
+    for (size_t j = 0; j < n; ++j)
+    {
+        sum += std::exp(a[j] + b[j] + c - max);
+    }
+
+    return max + std::log(sum);
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <limits>
+#include <cstdint>
+
+#include "spdlog/spdlog.h"
+
+// Best projective tree by Eisner's O(n^3) dynamic program, vertices are word positions and
+// root is vertex 0, edges into root are ignored. Parallel labels are reduced to the best one.
+// Complete spans are kept by start and by end, so every split loop reads contiguous memory.
+// Charts grow once and are reused by later calls, the graph is not changed.
+template<typename G>
+class ProjectiveDecoder
+{
+    typedef G::Vertex Vertex;
+    typedef G::Label Label;
+    typedef G::Edge Edge;
+    typedef G::Weight Weight;
+
+    typedef G::Edges Edges;
+
+    static constexpr Weight minusInf = -std::numeric_limits<Weight>::infinity();
+
+    enum Chart
+    {
+        RightComplete,
+        LeftComplete,
+        RightIncomplete,
+        LeftIncomplete,
+        ChartsNum
+    };
+
+    const G& graph;
+    size_t n = 0;
+
+    // Best arc weight and label by head * n + dependent
+    std::vector<Weight> scores;
+    std::vector<Label> labels;
+
+    // Complete spans [s, t] at s * n + t and at t * n + s,
+    // incomplete right ones at s * n + t, incomplete left ones at t * n + s
+    std::vector<Weight> completeByStart[2];
+    std::vector<Weight> completeByEnd[2];
+    std::vector<Weight> incomplete[2];
+
+    // Best split of every span of every chart at s * n + t
+    std::vector<uint32_t> splits[ChartsNum];
+
+    struct Span
+    {
+        Chart chart;
+        Vertex s;
+        Vertex t;
+    };
+    std::vector<Span> stack;
+
+    void collectScores()
+    {
+        scores.assign(n * n, minusInf);
+        labels.assign(n * n, 0);
+
+        // Arcs of weight minusInf never make a tree, so they are skipped as missing ones
+        for (Vertex d = 1; d < n; ++d)
+        {
+            graph.forEachIncoming(d, [&](Vertex h, Label l, const Weight& w)
+            {
+                if (h != d && w > scores[h * n + d])
+                {
+                    scores[h * n + d] = w;
+                    labels[h * n + d] = l;
+                }
+            });
+        }
+    }
+
+    void fill()
+    {
+        for (size_t dir = 0; dir < 2; ++dir)
+        {
+            completeByStart[dir].assign(n * n, minusInf);
+            completeByEnd[dir].assign(n * n, minusInf);
+            incomplete[dir].assign(n * n, minusInf);
+        }
+        for (auto& s: splits)
+        {
+            s.assign(n * n, 0);
+        }
+
+        for (Vertex s = 0; s < n; ++s)
+        {
+            for (size_t dir = 0; dir < 2; ++dir)
+            {
+                completeByStart[dir][s * n + s] = 0;
+                completeByEnd[dir][s * n + s] = 0;
+            }
+        }
+
+        const Weight* rightByStart = completeByStart[0].data();
+        const Weight* leftByStart = completeByStart[1].data();
+        const Weight* rightByEnd = completeByEnd[0].data();
+        const Weight* leftByEnd = completeByEnd[1].data();
+
+        for (Vertex k = 1; k < n; ++k)
+        {
+            for (Vertex s = 0; s + k < n; ++s)
+            {
+                const Vertex t = s + k;
+
+                // Both incomplete spans join [s, r] facing right and [r + 1, t] facing left
+                Weight best = minusInf;
+                uint32_t bestSplit = s;
+                for (Vertex r = s; r < t; ++r)
+                {
+                    const Weight w = rightByStart[s * n + r] + leftByEnd[t * n + r + 1];
+                    if (w > best)
+                    {
+                        best = w;
+                        bestSplit = r;
+                    }
+                }
+
+                incomplete[0][s * n + t] = best + scores[s * n + t];
+                splits[RightIncomplete][s * n + t] = bestSplit;
+
+                // Nothing depends on root
+                incomplete[1][t * n + s] = s == 0 ? minusInf : best + scores[t * n + s];
+                splits[LeftIncomplete][s * n + t] = bestSplit;
+
+                // Left complete [s, t] is left complete [s, r] and arc t -> r
+                best = minusInf;
+                bestSplit = s;
+                for (Vertex r = s; r < t; ++r)
+                {
+                    const Weight w = leftByStart[s * n + r] + incomplete[1][t * n + r];
+                    if (w > best)
+                    {
+                        best = w;
+                        bestSplit = r;
+                    }
+                }
+                completeByStart[1][s * n + t] = best;
+                completeByEnd[1][t * n + s] = best;
+                splits[LeftComplete][s * n + t] = bestSplit;
+
+                // Right complete [s, t] is arc s -> r and right complete [r, t]
+                best = minusInf;
+                bestSplit = t;
+                for (Vertex r = s + 1; r <= t; ++r)
+                {
+                    const Weight w = incomplete[0][s * n + r] + rightByEnd[t * n + r];
+                    if (w > best)
+                    {
+                        best = w;
+                        bestSplit = r;
+                    }
+                }
+                completeByStart[0][s * n + t] = best;
+                completeByEnd[0][t * n + s] = best;
+                splits[RightComplete][s * n + t] = bestSplit;
+            }
+        }
+    }
+
+    void addEdge(Vertex h, Vertex d, Edges& found) const
+    {
+        found[d - 1] = Edge {h, d, labels[h * n + d], graph.weight(h, d, labels[h * n + d])};
+    }
+
+    void backtrack(Edges& found)
+    {
+        stack.clear();
+        stack.push_back(Span {RightComplete, 0, Vertex(n - 1)});
+
+        while (!stack.empty())
+        {
+            const Span span = stack.back();
+            stack.pop_back();
+
+            const Vertex s = span.s;
+            const Vertex t = span.t;
+            if (s == t)
+            {
+                continue;
+            }
+
+            const Vertex r = splits[span.chart][s * n + t];
+            switch (span.chart)
+            {
+            case RightComplete:
+                stack.push_back(Span {RightIncomplete, s, r});
+                stack.push_back(Span {RightComplete, r, t});
+                break;
+            case LeftComplete:
+                stack.push_back(Span {LeftComplete, s, r});
+                stack.push_back(Span {LeftIncomplete, r, t});
+                break;
+            case RightIncomplete:
+                addEdge(s, t, found);
+                stack.push_back(Span {RightComplete, s, r});
+                stack.push_back(Span {LeftComplete, Vertex(r + 1), t});
+                break;
+            case LeftIncomplete:
+                addEdge(t, s, found);
+                stack.push_back(Span {RightComplete, s, r});
+                stack.push_back(Span {LeftComplete, Vertex(r + 1), t});
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+public:
+    ProjectiveDecoder(const G& _graph)
+        : graph(_graph)
+    {
+    }
+
+    // Edges of the tree sorted by destination, with their weights in the graph
+    std::optional<Edges> getSpanningTree(Vertex root)
+    {
+        if (root != 0)
+        {
+            spdlog::error("Projective decoder needs root at vertex 0, got {}", root);
+            return {};
+        }
+
+        n = graph.numVertices();
+        if (n == 0)
+        {
+            return {};
+        }
+
+        collectScores();
+        fill();
+
+        if (completeByStart[0][n - 1] == minusInf)
+        {
+            return {};
+        }
+
+        Edges found(n - 1);
+        backtrack(found);
+
+        return std::make_optional(found);
+    }
+};
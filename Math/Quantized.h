@@ -0,0 +1,348 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "MaxPlus.h"
+#include "../ZLibFile/ZLibFile.h"
+
+enum class Storage : uint8_t
+{
+    Float32 = 0,
+    Float16 = 1,
+    Int8 = 2,
+};
+
+inline bool validStorage(uint8_t storage)
+{
+    return storage <= uint8_t(Storage::Int8);
+}
+
+// IEEE half precision conversions, rounding to nearest even
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF)
+    {
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+
+    const int32_t halfExponent = int32_t(exponent) - 127 + 15;
+    if (halfExponent >= 0x1F)
+    {
+        return sign | 0x7C00;
+    }
+
+    if (halfExponent <= 0)
+    {
+        if (halfExponent < -10)
+        {
+            return sign;
+        }
+
+        // Subnormal half, the implicit bit becomes explicit
+        mantissa |= 0x800000;
+        const uint32_t shift = 14 - halfExponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (half & 1)))
+        {
+            ++half;
+        }
+        return sign | half;
+    }
+
+    uint32_t half = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    {
+        // Carry into the exponent gives infinity on overflow as it should
+        ++half;
+    }
+    return sign | half;
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    const uint32_t sign = uint32_t(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    uint32_t bits = 0;
+    if (exponent == 0x1F)
+    {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    else if (mantissa != 0)
+    {
+        // Subnormal half is a normal float
+        int32_t e = -14;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            --e;
+        }
+        bits = sign | (uint32_t(e + 127) << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    else
+    {
+        bits = sign;
+    }
+
+    float value = 0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline void halvesToFloatsScalar(const uint16_t* halves, size_t n, float* out)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = halfToFloat(halves[i]);
+    }
+}
+
+__attribute__((target("avx2,f16c")))
+inline void halvesToFloatsF16C(const uint16_t* halves, size_t n, float* out)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + i))));
+    }
+    halvesToFloatsScalar(halves + i, n - i, out + i);
+}
+
+inline bool hasF16C()
+{
+    static const bool supported = simdLevel() != SIMDLevel::Scalar && __builtin_cpu_supports("f16c");
+    return supported;
+}
+
+inline void halvesToFloats(const uint16_t* halves, size_t n, float* out)
+{
+    if (hasF16C())
+    {
+        halvesToFloatsF16C(halves, n, out);
+        return;
+    }
+    halvesToFloatsScalar(halves, n, out);
+}
+
+// Rows of log probabilities stored as fp16 or as 8 bit codes with per row minimum and step,
+// code 0 is reserved for -infinity. Row r is [offsets[r], offsets[r + 1]).
+template<typename N>
+class QuantizedRows
+{
+    static constexpr uint8_t maxCode = 255;
+
+    Storage storage = Storage::Float16;
+    std::vector<uint32_t> offsets = std::vector<uint32_t>(1, 0);
+
+    std::vector<uint16_t> halves;
+    std::vector<uint8_t> codes;
+    std::vector<float> mins;
+    std::vector<float> steps;
+
+    void encodeInt8(const N* values)
+    {
+        const size_t rows = offsets.size() - 1;
+        codes.resize(offsets.back());
+        mins.assign(rows, 0);
+        steps.assign(rows, 0);
+
+        for (size_t r = 0; r < rows; ++r)
+        {
+            float low = std::numeric_limits<float>::infinity();
+            float high = -std::numeric_limits<float>::infinity();
+            for (uint32_t i = offsets[r]; i < offsets[r + 1]; ++i)
+            {
+                if (std::isfinite(float(values[i])))
+                {
+                    low = std::min(low, float(values[i]));
+                    high = std::max(high, float(values[i]));
+                }
+            }
+
+            if (low > high)
+            {
+                low = high = 0;
+            }
+
+            mins[r] = low;
+            steps[r] = (high - low) / (maxCode - 1);
+
+            for (uint32_t i = offsets[r]; i < offsets[r + 1]; ++i)
+            {
+                if (!std::isfinite(float(values[i])))
+                {
+                    codes[i] = 0;
+                    continue;
+                }
+
+                const float code = steps[r] == 0 ? 0 : std::round((values[i] - low) / steps[r]);
+                codes[i] = 1 + uint8_t(std::clamp(code, 0.0f, float(maxCode - 1)));
+            }
+        }
+    }
+
+public:
+    bool operator==(const QuantizedRows<N>& other) const
+    {
+        return storage == other.storage
+            && offsets == other.offsets
+            && halves == other.halves
+            && codes == other.codes
+            && mins == other.mins
+            && steps == other.steps;
+    }
+
+    // Float32 is not a quantized storage, Float16 is used instead
+    void encode(Storage storage, const N* values, const std::vector<uint32_t>& offsets)
+    {
+        this->storage = storage == Storage::Int8 ? Storage::Int8 : Storage::Float16;
+        this->offsets = offsets;
+
+        halves.clear();
+        codes.clear();
+        mins.clear();
+        steps.clear();
+
+        if (this->storage == Storage::Int8)
+        {
+            encodeInt8(values);
+            return;
+        }
+
+        halves.resize(offsets.back());
+        for (size_t i = 0; i < halves.size(); ++i)
+        {
+            halves[i] = floatToHalf(values[i]);
+        }
+    }
+
+    Storage getStorage() const
+    {
+        return storage;
+    }
+
+    size_t rows() const
+    {
+        return offsets.size() - 1;
+    }
+
+    size_t size() const
+    {
+        return offsets.back();
+    }
+
+    // Bytes taken by the values and their scales
+    size_t bytes() const
+    {
+        return halves.size() * sizeof(uint16_t) + codes.size() + (mins.size() + steps.size()) * sizeof(float);
+    }
+
+    N at(size_t row, size_t i) const
+    {
+        const uint32_t ix = offsets[row] + i;
+        if (storage == Storage::Float16)
+        {
+            return halfToFloat(halves[ix]);
+        }
+
+        return codes[ix] == 0 ? -std::numeric_limits<N>::infinity() : mins[row] + (codes[ix] - 1) * steps[row];
+    }
+
+    // Whole row into out, it should have the row length
+    void decode(size_t row, N* out) const
+    {
+        const uint32_t begin = offsets[row];
+        const uint32_t n = offsets[row + 1] - begin;
+
+        if (storage == Storage::Float16)
+        {
+            if constexpr (std::is_same_v<N, float>)
+            {
+                halvesToFloats(&halves[begin], n, out);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < n; ++i)
+                {
+                    out[i] = halfToFloat(halves[begin + i]);
+                }
+            }
+            return;
+        }
+
+        const float low = mins[row];
+        const float step = steps[row];
+        const uint8_t* rowCodes = &codes[begin];
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            out[i] = low + (rowCodes[i] - 1) * step;
+        }
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            if (rowCodes[i] == 0)
+            {
+                out[i] = -std::numeric_limits<N>::infinity();
+            }
+        }
+    }
+
+    void saveBinary(ZLibFile& zfile) const
+    {
+        zfile.write(uint8_t(storage));
+        zfile.write(offsets);
+        zfile.write(halves);
+        zfile.write(codes);
+        zfile.write(mins);
+        zfile.write(steps);
+    }
+
+    bool loadBinary(ZLibFile& zfile)
+    {
+        uint8_t storageByte = 0;
+        if (!zfile.read(storageByte) || !validStorage(storageByte) || Storage(storageByte) == Storage::Float32)
+        {
+            return false;
+        }
+        storage = Storage(storageByte);
+
+        if (!zfile.read(offsets)
+            || !zfile.read(halves)
+            || !zfile.read(codes)
+            || !zfile.read(mins)
+            || !zfile.read(steps)
+            || offsets.empty())
+        {
+            return false;
+        }
+
+        if (storage == Storage::Float16)
+        {
+            return halves.size() == offsets.back() && codes.empty();
+        }
+
+        return codes.size() == offsets.back() && mins.size() == rows() && steps.size() == rows() && halves.empty();
+    }
+};
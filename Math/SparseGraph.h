@@ -0,0 +1,200 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "Graph.h"
+
+// Graph with the interface of Graph, every vertex keeps a contiguous array of its incoming edges
+// sorted by source and label, so sparse or pruned graphs take memory and time by their edges.
+// Edges are the ones of Graph, so both representations can be built from and compared by them.
+template<typename W, typename V>
+class SparseGraph
+{
+private:
+    static constexpr W noEdge = NAN;
+
+    struct Incoming
+    {
+        V src;
+        V label;
+        W weight;
+
+        bool operator<(const Incoming& other) const
+        {
+            return src < other.src || (src == other.src && label < other.label);
+        }
+    };
+
+    // Only the first vertices are used, the arrays of the others keep their memory for reset
+    std::vector<std::vector<Incoming>> incoming;
+    V vertices;
+    V labels;
+
+    auto find(V src, V dest, V label) const
+    {
+        const auto& in = incoming[dest];
+        const Incoming key {src, label, noEdge};
+        const auto it = std::lower_bound(in.begin(), in.end(), key);
+        return it != in.end() && it->src == src && it->label == label ? it : in.end();
+    }
+
+public:
+    typedef Graph<W, V>::Edge Edge;
+
+    typedef std::vector<Edge> Edges;
+
+    typedef V Vertex;
+
+    typedef V Label;
+
+    typedef W Weight;
+
+    SparseGraph(Vertex numVertices, Label numLabels)
+        : incoming(numVertices)
+        , vertices(numVertices)
+        , labels(numLabels)
+    {
+    }
+
+    SparseGraph(Vertex numVertices, Label numLabels, const Edges& edges)
+        : incoming(numVertices)
+        , vertices(numVertices)
+        , labels(numLabels)
+    {
+        std::for_each(edges.begin(), edges.end(), [&](const auto &e) { addEdge(e); });
+    }
+
+    // Empty graph of the given size, the incoming arrays keep their memory
+    void reset(Vertex numVertices, Label numLabels)
+    {
+        if (numVertices > incoming.size())
+        {
+            incoming.resize(numVertices);
+        }
+        for (Vertex v = 0; v < numVertices; ++v)
+        {
+            incoming[v].clear();
+        }
+        vertices = numVertices;
+        labels = numLabels;
+    }
+
+    Vertex numVertices() const
+    {
+        return vertices;
+    }
+
+    Label numLabels() const
+    {
+        return labels;
+    }
+
+    size_t numEdges() const
+    {
+        size_t res = 0;
+        for (Vertex v = 0; v < vertices; ++v)
+        {
+            res += incoming[v].size();
+        }
+        return res;
+    }
+
+    static bool isEdge(W w)
+    {
+        return !std::isnan(w);
+    }
+
+    // Adding noEdge removes the edge, as in Graph
+    void addEdge(Vertex src, Vertex dest, Label label, W weight)
+    {
+        if (!isEdge(weight))
+        {
+            removeEdge(src, dest, label);
+            return;
+        }
+
+        auto& in = incoming[dest];
+        const Incoming e {src, label, weight};
+        const auto it = std::lower_bound(in.begin(), in.end(), e);
+        if (it != in.end() && it->src == src && it->label == label)
+        {
+            it->weight = weight;
+        }
+        else
+        {
+            in.insert(it, e);
+        }
+    }
+
+    void addEdge(const Edge& e)
+    {
+        addEdge(e.src, e.dest, e.label, e.weight);
+    }
+
+    void removeEdge(Vertex src, Vertex dest, V label)
+    {
+        const auto it = find(src, dest, label);
+        if (it != incoming[dest].end())
+        {
+            incoming[dest].erase(it);
+        }
+    }
+
+    void removeEdge(Edge e)
+    {
+        removeEdge(e.src, e.dest, e.label);
+    }
+
+    // noEdge for missing edges, weights are changed by addEdge or forEachIncoming
+    W weight(Vertex src, Vertex dest, Label label) const
+    {
+        const auto it = find(src, dest, label);
+        return it != incoming[dest].end() ? it->weight : noEdge;
+    }
+
+    // Calls f(src, label, weight) for every edge into dest, by source and then by label
+    template<typename F>
+    void forEachIncoming(Vertex dest, F f) const
+    {
+        for (const auto& e: incoming[dest])
+        {
+            f(e.src, e.label, e.weight);
+        }
+    }
+
+    template<typename F>
+    void forEachIncoming(Vertex dest, F f)
+    {
+        for (auto& e: incoming[dest])
+        {
+            f(e.src, e.label, e.weight);
+        }
+    }
+
+    // Sorted by destination, then by source and label
+    Edges edges() const
+    {
+        Edges res;
+        res.reserve(numEdges());
+        for (Vertex dest = 0; dest < vertices; ++dest)
+        {
+            for (const auto& e: incoming[dest])
+            {
+                res.push_back(Edge {e.src, dest, e.label, e.weight});
+            }
+        }
+        return res;
+    }
+
+    static void saveDot(std::ostream& stream, const Edges& edges)
+    {
+        Graph<W, V>::saveDot(stream, edges);
+    }
+
+    void saveDot(std::ostream& stream) const
+    {
+        saveDot(stream, edges());
+    }
+};
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+
+#include "DSU.h"
+
+// Chu-Liu Edmonds Maximum Spanning Tree by Tarjan: every vertex keeps a mergeable heap of its
+// incoming edges, cycles are contracted by merging the heaps and joining the vertices in a DSU,
+// the tree is restored by undoing the joins in reverse order.
+// Only the best label of parallel edges can be chosen, so one edge per vertex pair goes into the heaps.
+// The graph is not changed.
+template<typename G>
+class TarjanMST
+{
+    typedef G::Vertex Vertex;
+    typedef G::Label Label;
+    typedef G::Edge Edge;
+    typedef G::Weight Weight;
+
+    typedef G::Edges Edges;
+
+    static constexpr uint32_t none = uint32_t(-1);
+
+    // Leftist max-heap node, shift is added to the keys of the children when they are reached
+    struct Node
+    {
+        Weight key;
+        Weight shift;
+        uint32_t edge;
+        uint32_t left;
+        uint32_t right;
+        uint32_t rank;
+    };
+
+    struct Cycle
+    {
+        Vertex vertex;
+        size_t time;
+        size_t begin;
+        size_t end;
+    };
+
+    const G& graph;
+
+    Edges edges;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> heaps;
+    std::vector<uint32_t> queue;
+
+    std::vector<Vertex> seen;
+    std::vector<Vertex> path;
+    std::vector<uint32_t> chosen;
+    std::vector<uint32_t> incoming;
+    std::vector<Cycle> cycles;
+    std::vector<uint32_t> cycleEdges;
+
+    uint32_t rank(uint32_t n) const
+    {
+        return n == none ? 0 : nodes[n].rank;
+    }
+
+    void shift(uint32_t n, Weight w)
+    {
+        if (n != none)
+        {
+            nodes[n].key += w;
+            nodes[n].shift += w;
+        }
+    }
+
+    void pushShift(uint32_t n)
+    {
+        Node& node = nodes[n];
+        if (node.shift != 0)
+        {
+            shift(node.left, node.shift);
+            shift(node.right, node.shift);
+            node.shift = 0;
+        }
+    }
+
+    // Recursion goes along right spines only, they are logarithmic
+    uint32_t merge(uint32_t a, uint32_t b)
+    {
+        if (a == none)
+        {
+            return b;
+        }
+        if (b == none)
+        {
+            return a;
+        }
+        if (nodes[a].key < nodes[b].key)
+        {
+            std::swap(a, b);
+        }
+
+        pushShift(a);
+        const uint32_t right = merge(nodes[a].right, b);
+
+        Node& node = nodes[a];
+        node.right = right;
+        if (rank(node.left) < rank(node.right))
+        {
+            std::swap(node.left, node.right);
+        }
+        node.rank = rank(node.right) + 1;
+        return a;
+    }
+
+    uint32_t pop(uint32_t n)
+    {
+        pushShift(n);
+        return merge(nodes[n].left, nodes[n].right);
+    }
+
+    // Pairwise merging of nodes [first, last), linear in their number
+    uint32_t build(uint32_t first, uint32_t last)
+    {
+        queue.clear();
+        for (uint32_t n = first; n < last; ++n)
+        {
+            queue.push_back(n);
+        }
+
+        if (queue.empty())
+        {
+            return none;
+        }
+
+        for (size_t head = 0; head + 1 < queue.size(); head += 2)
+        {
+            queue.push_back(merge(queue[head], queue[head + 1]));
+        }
+        return queue.back();
+    }
+
+    void collectEdges(Vertex root)
+    {
+        const Vertex n = graph.numVertices();
+
+        edges.clear();
+        nodes.clear();
+        heaps.assign(n, none);
+
+        for (Vertex dest = 0; dest < n; ++dest)
+        {
+            if (dest == root)
+            {
+                continue;
+            }
+
+            const uint32_t first = nodes.size();
+
+            // Incoming edges come by source, so the labels of a pair are next to each other
+            Edge best;
+            bool found = false;
+            auto push = [&]()
+            {
+                nodes.push_back(Node {best.weight, 0, uint32_t(edges.size()), none, none, 1});
+                edges.push_back(best);
+            };
+
+            graph.forEachIncoming(dest, [&](Vertex src, Label l, const Weight& w)
+            {
+                if (src == dest)
+                {
+                    return;
+                }
+                if (found && src != best.src)
+                {
+                    push();
+                    found = false;
+                }
+                if (!found || w > best.weight)
+                {
+                    best = Edge {src, dest, l, w};
+                    found = true;
+                }
+            });
+
+            if (found)
+            {
+                push();
+            }
+            heaps[dest] = build(first, nodes.size());
+        }
+    }
+
+public:
+    TarjanMST(const G& _graph)
+        : graph(_graph)
+    {
+    }
+
+    // Edges of the tree sorted by destination, with their weights in the graph
+    std::optional<Edges> getSpanningTree(Vertex root)
+    {
+        const Vertex n = graph.numVertices();
+        spdlog::debug("Get maximal spanning tree by Tarjan, {} vertices, {} labels", n, graph.numLabels());
+
+        collectEdges(root);
+
+        RollbackDSU<Vertex> dsu(n);
+
+        seen.assign(n, Vertex(-1));
+        path.resize(n);
+        chosen.resize(n);
+        incoming.assign(n, none);
+        cycles.clear();
+        cycleEdges.clear();
+
+        seen[root] = root;
+
+        for (Vertex s = 0; s < n; ++s)
+        {
+            Vertex u = s;
+            size_t length = 0;
+            while (seen[u] == Vertex(-1))
+            {
+                // Edges inside a contracted vertex are loops now
+                while (heaps[u] != none && dsu.find(edges[nodes[heaps[u]].edge].src) == u)
+                {
+                    heaps[u] = pop(heaps[u]);
+                }
+
+                if (heaps[u] == none)
+                {
+                    spdlog::debug("No incoming edges for vertex {}", u);
+                    return {};
+                }
+
+                const uint32_t top = heaps[u];
+                const Weight w = nodes[top].key;
+                heaps[u] = pop(top);
+                if (std::isfinite(w))
+                {
+                    shift(heaps[u], -w);
+                }
+
+                chosen[length] = nodes[top].edge;
+                path[length++] = u;
+                seen[u] = s;
+
+                u = dsu.find(edges[nodes[top].edge].src);
+                if (seen[u] == s)
+                {
+                    const size_t end = length;
+                    const size_t time = dsu.time();
+
+                    uint32_t cycle = none;
+                    Vertex v = 0;
+                    do
+                    {
+                        v = path[--length];
+                        cycle = merge(cycle, heaps[v]);
+                    }
+                    while (dsu.makeUnion(u, v));
+
+                    u = dsu.find(u);
+                    heaps[u] = cycle;
+                    seen[u] = Vertex(-1);
+
+                    cycles.push_back(Cycle {u, time, cycleEdges.size(), cycleEdges.size() + end - length});
+                    cycleEdges.insert(cycleEdges.end(), chosen.begin() + length, chosen.begin() + end);
+                }
+            }
+
+            for (size_t i = 0; i < length; ++i)
+            {
+                incoming[dsu.find(edges[chosen[i]].dest)] = chosen[i];
+            }
+        }
+
+        spdlog::debug("Contracted {} cycles", cycles.size());
+
+        // The edge entering a cycle replaces the cycle edge with the same destination
+        for (auto it = cycles.rbegin(); it != cycles.rend(); ++it)
+        {
+            dsu.rollback(it->time);
+            const uint32_t entering = incoming[it->vertex];
+            for (size_t i = it->begin; i < it->end; ++i)
+            {
+                incoming[dsu.find(edges[cycleEdges[i]].dest)] = cycleEdges[i];
+            }
+            incoming[dsu.find(edges[entering].dest)] = entering;
+        }
+
+        Edges found;
+        found.reserve(n - 1);
+        for (Vertex v = 0; v < n; ++v)
+        {
+            if (v != root)
+            {
+                found.push_back(edges[incoming[v]]);
+            }
+        }
+
+        return std::make_optional(found);
+    }
+};
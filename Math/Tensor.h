@@ -78,10 +78,10 @@ class Tensor
     {
         spdlog::debug("Free Tensor");
 
-        delete data;
+        delete[] data;
         data = nullptr;
 
-        delete sums;
+        delete[] sums;
         sums = nullptr;
     }
 
@@ -128,7 +128,7 @@ class Tensor
 
     void calculateSums(IndexT ix)
     {
-        delete sums;
+        delete[] sums;
 
         sumsSize = sizes[ix];
         sums = new N[sumsSize];
@@ -213,6 +213,14 @@ public:
         allocate(_initialValue);
     }
 
+    void swap(Tensor<N, IndexT, Arity>& other)
+    {
+        sizes.swap(other.sizes);
+        std::swap(data, other.data);
+        std::swap(sums, other.sums);
+        std::swap(sumsSize, other.sumsSize);
+    }
+
     bool operator==(const Tensor<N, IndexT, Arity>& other) const
     {
         return sizes == other.sizes && memcmp(data, other.data, size() * sizeof(N)) == 0;
@@ -32,11 +32,61 @@ bool trainTagger(float smoothingFactor)
     return Engine::singleton().trainTagger(smoothingFactor);
 }
 
+bool trainTaggerWithOrder(float smoothingFactor, size_t order)
+{
+    return Engine::singleton().trainTagger(smoothingFactor, order);
+}
+
+bool addSentences(char* path, char* parserName)
+{
+    return Engine::singleton().addSentences(path, parserName);
+}
+
+bool quantizeTagger(size_t storage)
+{
+    if (storage > 0xFF || !validStorage(storage))
+    {
+        spdlog::error("Storage {} is not supported", storage);
+        return false;
+    }
+
+    return Engine::singleton().quantizeTagger(Storage(storage));
+}
+
 bool trainTreeBuilder(float smoothingFactor)
 {
     return Engine::singleton().trainTreeBuilder(smoothingFactor);
 }
 
+bool enableTreeTrace(char* directory, size_t sampleEvery)
+{
+    if (!directory)
+    {
+        spdlog::error("Directory is null");
+        return false;
+    }
+
+    return Engine::singleton().enableTreeTrace(directory, sampleEvery);
+}
+
+bool disableTreeTrace(void)
+{
+    Engine::singleton().disableTreeTrace();
+    return true;
+}
+
+bool setTreeSolver(size_t solver)
+{
+    if (!validTreeSolver(solver))
+    {
+        spdlog::error("Tree solver {} is not supported", solver);
+        return false;
+    }
+
+    Engine::singleton().setTreeSolver(TreeSolver(solver));
+    return true;
+}
+
 bool saveSentences(char* path)
 {
     return Engine::singleton().saveSentences(path);
@@ -112,7 +162,7 @@ bool word2index(char* word, size_t* result)
     return true;
 }
 
-bool tag(size_t* words, size_t len, size_t* result)
+static bool tagImpl(size_t* words, size_t len, size_t* result, bool useLexicon, size_t beamWidth)
 {
     if (!result)
     {
@@ -120,10 +170,53 @@ bool tag(size_t* words, size_t len, size_t* result)
         return false;
     }
 
-    Words v(len);
-    std::copy(words, words + len, v.begin());
+    // Kept between calls, so tagging does not allocate once they have grown
+    thread_local Words v;
+    thread_local Tags res;
+    v.assign(words, words + len);
+
+    if (!Engine::singleton().tag(v, res, useLexicon, beamWidth))
+    {
+        return false;
+    }
+
+    std::copy(res.begin(), res.end(), result);
+
+    return true;
+}
+
+bool tag(size_t* words, size_t len, size_t* result)
+{
+    return tagImpl(words, len, result, false, 0);
+}
+
+bool tagWithLexicon(size_t* words, size_t len, size_t* result)
+{
+    return tagImpl(words, len, result, true, 0);
+}
+
+bool tagBeam(size_t* words, size_t len, size_t beamWidth, bool useLexicon, size_t* result)
+{
+    if (beamWidth == 0)
+    {
+        spdlog::error("Beam width is zero");
+        return false;
+    }
+
+    return tagImpl(words, len, result, useLexicon, beamWidth);
+}
+
+bool tagForms(char** forms, size_t len, size_t beamWidth, bool useLexicon, size_t* result)
+{
+    if (!result || !forms)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    Strings v(forms, forms + len);
 
-    std::optional<Tags> res = Engine::singleton().tag(v);
+    std::optional<Tags> res = Engine::singleton().tagForms(v, useLexicon, beamWidth);
 
     if (!res)
     {
@@ -135,6 +228,117 @@ bool tag(size_t* words, size_t len, size_t* result)
     return true;
 }
 
+bool tagBatch(size_t* words, size_t* offsets, size_t sentences, size_t beamWidth, bool useLexicon, size_t* result)
+{
+    if (!result || !words || !offsets)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    const size_t len = offsets[sentences];
+
+    Words v(words, words + len);
+    std::vector<size_t> o(offsets, offsets + sentences + 1);
+    Tags res;
+
+    if (!Engine::singleton().tagBatch(v, o, res, useLexicon, beamWidth))
+    {
+        return false;
+    }
+
+    std::copy(res.begin(), res.end(), result);
+
+    return true;
+}
+
+bool tagPosteriors(size_t* words, size_t len, size_t k, bool useLexicon, size_t* tags, float* probabilities)
+{
+    if (!tags || !probabilities)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    Words v(words, words + len);
+
+    std::optional<TagPosteriors> res = Engine::singleton().tagPosteriors(v, k, useLexicon);
+
+    if (!res)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < res->size(); ++i)
+    {
+        tags[i] = (*res)[i].state;
+        probabilities[i] = (*res)[i].probability;
+    }
+
+    return true;
+}
+
+bool tagNBest(size_t* words, size_t len, size_t k, bool useLexicon, size_t* tags, float* scores, size_t* found)
+{
+    if (!tags || !scores || !found)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    Words v(words, words + len);
+
+    std::optional<TagSequences> res = Engine::singleton().tagNBest(v, k, useLexicon);
+
+    if (!res)
+    {
+        return false;
+    }
+
+    *found = res->size();
+    for (size_t p = 0; p < res->size(); ++p)
+    {
+        std::copy((*res)[p].states.begin(), (*res)[p].states.end(), tags + p * len);
+        scores[p] = (*res)[p].score;
+    }
+
+    return true;
+}
+
+static bool streamImpl(bool flush, size_t word, bool useLexicon, size_t* result, size_t* decided)
+{
+    if (!result || !decided)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    thread_local Tags tags;
+    tags.clear();
+
+    const bool res = flush ? Engine::singleton().flushWords(tags) : Engine::singleton().pushWord(word, tags, useLexicon);
+
+    std::copy(tags.begin(), tags.end(), result);
+    *decided = tags.size();
+
+    return res;
+}
+
+bool pushWord(size_t word, bool useLexicon, size_t* result, size_t* decided)
+{
+    return streamImpl(false, word, useLexicon, result, decided);
+}
+
+bool flushWords(size_t* result, size_t* decided)
+{
+    return streamImpl(true, 0, false, result, decided);
+}
+
+size_t tagStreamLatency(void)
+{
+    return Engine::streamLatency;
+}
+
 bool getCompoundPOSTag(size_t tag, size_t* result, size_t* len)
 {
     if (!result || !len)
@@ -230,7 +434,7 @@ bool index2FeatureValue(size_t tag, char** result)
     return true;
 }
 
-bool buildDependencyTree(size_t* tags, size_t len, size_t* result)
+static bool buildDependencyTreeImpl(size_t* tags, size_t len, std::optional<TreeSolver> solver, size_t* result)
 {
     if (!result)
     {
@@ -241,7 +445,7 @@ bool buildDependencyTree(size_t* tags, size_t len, size_t* result)
     std::vector<TagId> t(len);
     std::copy(tags, tags + len, t.begin());
 
-    std::optional<DepRelStatistics::Edges> res = Engine::singleton().buildDependencyTree(t);
+    std::optional<DepRelStatistics::Edges> res = Engine::singleton().buildDependencyTree(t, solver);
 
     if (!res)
     {
@@ -258,6 +462,113 @@ bool buildDependencyTree(size_t* tags, size_t len, size_t* result)
     return true;
 }
 
+bool buildDependencyTree(size_t* tags, size_t len, size_t* result)
+{
+    return buildDependencyTreeImpl(tags, len, std::nullopt, result);
+}
+
+bool buildDependencyTreeWith(size_t* tags, size_t len, size_t solver, size_t* result)
+{
+    if (!validTreeSolver(solver))
+    {
+        spdlog::error("Tree solver {} is not supported", solver);
+        return false;
+    }
+
+    return buildDependencyTreeImpl(tags, len, TreeSolver(solver), result);
+}
+
+bool buildDependencyTrees(size_t* tags, size_t* offsets, size_t sentences, size_t* result)
+{
+    if (!result || !tags || !offsets)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    const size_t len = offsets[sentences];
+
+    Tags t(tags, tags + len);
+    std::vector<size_t> o(offsets, offsets + sentences + 1);
+    DepRelStatistics::Edges res;
+
+    if (!Engine::singleton().buildDependencyTrees(t, o, res))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        result[3 * i] = res[i].src;
+        result[3 * i + 1] = res[i].dest;
+        result[3 * i + 2] = res[i].label;
+    }
+
+    return true;
+}
+
+bool buildDependencyTreeNBest(size_t* tags, size_t len, size_t k, size_t* result, float* scores, size_t* found)
+{
+    if (!result || !scores || !found)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    std::vector<TagId> t(tags, tags + len);
+
+    std::optional<DepRelStatistics::ScoredTrees> res = Engine::singleton().buildDependencyTreeNBest(t, k);
+
+    if (!res)
+    {
+        return false;
+    }
+
+    *found = res->size();
+    for (size_t p = 0; p < res->size(); ++p)
+    {
+        const auto& edges = (*res)[p].edges;
+        for (size_t i = 0; i < len; ++i)
+        {
+            result[3 * (p * len + i)] = edges[i].src;
+            result[3 * (p * len + i) + 1] = edges[i].dest;
+            result[3 * (p * len + i) + 2] = edges[i].label;
+        }
+        scores[p] = (*res)[p].score;
+    }
+
+    return true;
+}
+
+bool analyze(size_t* words, size_t len, size_t beamWidth, bool useLexicon, size_t* tags, size_t* edges)
+{
+    if (!tags || !edges)
+    {
+        spdlog::error("Result is null");
+        return false;
+    }
+
+    // Kept between calls, so analysis does not allocate once they have grown
+    thread_local Words v;
+    thread_local Analysis res;
+    v.assign(words, words + len);
+
+    if (!Engine::singleton().analyze(v, res, useLexicon, beamWidth))
+    {
+        return false;
+    }
+
+    std::copy(res.tags.begin(), res.tags.end(), tags);
+    for (size_t i = 0; i < len; ++i)
+    {
+        edges[3 * i] = res.edges[i].src;
+        edges[3 * i + 1] = res.edges[i].dest;
+        edges[3 * i + 2] = res.edges[i].label;
+    }
+
+    return true;
+}
+
 bool getCompoundDeprelTag(size_t tag, size_t* result, size_t* len)
 {
     if (!result || !len)
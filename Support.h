@@ -16,8 +16,23 @@ bool parse(char* path, char* parserName);
 
 bool trainTagger(float smoothingFactor);
 
+bool trainTaggerWithOrder(float smoothingFactor, size_t order);
+
+bool addSentences(char* path, char* parserName);
+
+// Storage 1 is fp16, 2 is int8 with per row scales, 0 keeps float32
+bool quantizeTagger(size_t storage);
+
 bool trainTreeBuilder(float smoothingFactor);
 
+// Every sampleEvery-th dependency tree is written with its graph as dot files into directory, in background
+bool enableTreeTrace(char* directory, size_t sampleEvery);
+
+bool disableTreeTrace(void);
+
+// Solver 0 is the original Chu-Liu Edmonds, 1 is Tarjan's one, the default, 2 is the projective Eisner's one
+bool setTreeSolver(size_t solver);
+
 bool saveTagger(char* path);
 
 bool loadTagger(char* path);
@@ -42,6 +57,29 @@ bool word2index(char* word, size_t* result);
     
 bool tag(size_t* words, size_t len, size_t* result);
 
+bool tagWithLexicon(size_t* words, size_t len, size_t* result);
+
+bool tagBeam(size_t* words, size_t len, size_t beamWidth, bool useLexicon, size_t* result);
+
+// Forms are looked up in the words collection, unknown ones are tagged by their suffixes
+bool tagForms(char** forms, size_t len, size_t beamWidth, bool useLexicon, size_t* result);
+
+bool tagBatch(size_t* words, size_t* offsets, size_t sentences, size_t beamWidth, bool useLexicon, size_t* result);
+
+// k entries per word in tags and probabilities, sorted by probability
+bool tagPosteriors(size_t* words, size_t len, size_t k, bool useLexicon, size_t* tags, float* probabilities);
+
+// Up to k best tag sequences one after another in tags, found of them, with their log probabilities
+bool tagNBest(size_t* words, size_t len, size_t k, bool useLexicon, size_t* tags, float* scores, size_t* found);
+
+// Streaming tagging: tags that can not change any more are written to result, their number to decided.
+// result should have room for tagStreamLatency() tags.
+bool pushWord(size_t word, bool useLexicon, size_t* result, size_t* decided);
+
+bool flushWords(size_t* result, size_t* decided);
+
+size_t tagStreamLatency(void);
+
 bool getCompoundPOSTag(size_t tag, size_t* result, size_t* len);
 
 bool index2POSTag(size_t tag, char** result);
@@ -53,6 +91,18 @@ bool index2FeatureValue(size_t tag, char** result);
 
 bool buildDependencyTree(size_t* tags, size_t len, size_t* result);
 
+// Same as above by the given solver, see setTreeSolver
+bool buildDependencyTreeWith(size_t* tags, size_t len, size_t solver, size_t* result);
+
+// Sentence i is tags[offsets[i], offsets[i + 1]), its (src, dest, label) edges go to result from 3 * offsets[i]
+bool buildDependencyTrees(size_t* tags, size_t* offsets, size_t sentences, size_t* result);
+
+// Up to k best trees one after another in result, 3 * len entries each, found of them, with their scores
+bool buildDependencyTreeNBest(size_t* tags, size_t len, size_t k, size_t* result, float* scores, size_t* found);
+
+// Tags the words into tags and builds their tree into edges as buildDependencyTree does, in one call
+bool analyze(size_t* words, size_t len, size_t beamWidth, bool useLexicon, size_t* tags, size_t* edges);
+
 bool getCompoundDeprelTag(size_t tag, size_t* result, size_t* len);
 
 bool index2dependencyRelation(size_t tag, char** result);
@@ -15,10 +15,16 @@ foreign import capi "Support.h saveEncoder" saveEncoder' :: CString -> IO CBool
 foreign import capi "Support.h loadEncoder" loadEncoder' :: CString -> IO CBool
 
 foreign import capi "Support.h trainTagger" trainTagger' :: CFloat -> IO CBool
+foreign import capi "Support.h trainTaggerWithOrder" trainTaggerWithOrder' :: CFloat -> CULong -> IO CBool
+foreign import capi "Support.h addSentences" addSentences' :: CString -> CString -> IO CBool
+foreign import capi "Support.h quantizeTagger" quantizeTagger' :: CULong -> IO CBool
 foreign import capi "Support.h saveTagger" saveTagger' :: CString -> IO CBool
 foreign import capi "Support.h loadTagger" loadTagger' :: CString -> IO CBool
 
 foreign import capi "Support.h trainTreeBuilder" trainTreeBuilder' :: CFloat -> IO CBool
+foreign import capi "Support.h enableTreeTrace" enableTreeTrace' :: CString -> CULong -> IO CBool
+foreign import capi "Support.h disableTreeTrace" disableTreeTrace' :: IO CBool
+foreign import capi "Support.h setTreeSolver" setTreeSolver' :: CULong -> IO CBool
 foreign import capi "Support.h saveTreeBuilder" saveTreeBuilder' :: CString -> IO CBool
 foreign import capi "Support.h loadTreeBuilder" loadTreeBuilder' :: CString -> IO CBool
 
@@ -26,6 +32,15 @@ foreign import capi "Support.h index2word" index2word' :: CULong -> Ptr CString
 foreign import capi "Support.h word2index" word2index' :: CString -> Ptr CULong -> IO CBool
 
 foreign import capi "Support.h tag" tag' :: Ptr CULong -> CULong -> Ptr CULong -> IO CBool
+foreign import capi "Support.h tagWithLexicon" tagWithLexicon' :: Ptr CULong -> CULong -> Ptr CULong -> IO CBool
+foreign import capi "Support.h tagBeam" tagBeam' :: Ptr CULong -> CULong -> CULong -> CBool -> Ptr CULong -> IO CBool
+foreign import capi "Support.h tagForms" tagForms' :: Ptr CString -> CULong -> CULong -> CBool -> Ptr CULong -> IO CBool
+foreign import capi "Support.h tagBatch" tagBatch' :: Ptr CULong -> Ptr CULong -> CULong -> CULong -> CBool -> Ptr CULong -> IO CBool
+foreign import capi "Support.h tagPosteriors" tagPosteriors' :: Ptr CULong -> CULong -> CULong -> CBool -> Ptr CULong -> Ptr CFloat -> IO CBool
+foreign import capi "Support.h tagNBest" tagNBest' :: Ptr CULong -> CULong -> CULong -> CBool -> Ptr CULong -> Ptr CFloat -> Ptr CULong -> IO CBool
+foreign import capi "Support.h pushWord" pushWord' :: CULong -> CBool -> Ptr CULong -> Ptr CULong -> IO CBool
+foreign import capi "Support.h flushWords" flushWords' :: Ptr CULong -> Ptr CULong -> IO CBool
+foreign import capi "Support.h tagStreamLatency" tagStreamLatency' :: IO CULong
 
 foreign import capi "Support.h getCompoundPOSTag" getCompoundPOSTag' :: CULong -> Ptr CULong -> Ptr CULong -> IO CBool
 foreign import capi "Support.h index2POSTag" index2POSTag' :: CULong -> Ptr CString -> IO CBool
@@ -33,6 +48,10 @@ foreign import capi "Support.h index2FeatureName" index2FeatureName' :: CULong -
 foreign import capi "Support.h index2FeatureValue" index2FeatureValue' :: CULong -> Ptr CString -> IO CBool
 
 foreign import capi "Support.h buildDependencyTree" buildDependencyTree' :: Ptr CULong -> CULong -> Ptr CULong -> IO CBool
+foreign import capi "Support.h buildDependencyTrees" buildDependencyTrees' :: Ptr CULong -> Ptr CULong -> CULong -> Ptr CULong -> IO CBool
+foreign import capi "Support.h buildDependencyTreeWith" buildDependencyTreeWith' :: Ptr CULong -> CULong -> CULong -> Ptr CULong -> IO CBool
+foreign import capi "Support.h buildDependencyTreeNBest" buildDependencyTreeNBest' :: Ptr CULong -> CULong -> CULong -> Ptr CULong -> Ptr CFloat -> Ptr CULong -> IO CBool
+foreign import capi "Support.h analyze" analyze' :: Ptr CULong -> CULong -> CULong -> CBool -> Ptr CULong -> Ptr CULong -> IO CBool
 foreign import capi "Support.h getCompoundDeprelTag" getCompoundDeprelTag' :: CULong -> Ptr CULong -> Ptr CULong -> IO CBool
 foreign import capi "Support.h index2dependencyRelation" index2dependencyRelation' :: CULong -> Ptr CString -> IO CBool
 foreign import capi "Support.h index2dependencyRelationModifier" index2dependencyRelationModifier' :: CULong -> Ptr CString -> IO CBool
@@ -73,11 +92,44 @@ trainTagger sf = do
     res <- trainTagger' (realToFrac sf)
     return $ toBool res
 
+trainTaggerWithOrder :: Float -> Int -> IO Bool
+trainTaggerWithOrder sf order = do
+    res <- trainTaggerWithOrder' (realToFrac sf) (toEnum order)
+    return $ toBool res
+
+addSentences :: FilePath -> String -> IO Bool
+addSentences path parser = do
+    cpath <- newCString path
+    cparser <- newCString parser
+    res <- addSentences' cpath cparser
+    return $ toBool res
+
+quantizeTagger :: Int -> IO Bool
+quantizeTagger storage = do
+    res <- quantizeTagger' (toEnum storage)
+    return $ toBool res
+
 trainTreeBuilder :: Float -> IO Bool
 trainTreeBuilder sf = do
     res <- trainTreeBuilder' (realToFrac sf)
     return $ toBool res
 
+enableTreeTrace :: FilePath -> Int -> IO Bool
+enableTreeTrace path sampleEvery = do
+    cpath <- newCString path
+    res <- enableTreeTrace' cpath (toEnum sampleEvery)
+    return $ toBool res
+
+disableTreeTrace :: IO Bool
+disableTreeTrace = do
+    res <- disableTreeTrace'
+    return $ toBool res
+
+setTreeSolver :: Int -> IO Bool
+setTreeSolver solver = do
+    res <- setTreeSolver' (toEnum solver)
+    return $ toBool res
+
 saveTagger :: FilePath -> IO Bool
 saveTagger path = do
     cpath <- newCString path
@@ -109,11 +161,20 @@ word2index :: String -> IO (Maybe Int)
 word2index = string2index word2index'
 
 tag :: [Int] -> IO (Maybe [Int])
-tag ws = do
-    css <- callocArray size
-    pokeArray css $ map toEnum ws
+tag = tagWith tag'
+
+tagWithLexicon :: [Int] -> IO (Maybe [Int])
+tagWithLexicon = tagWith tagWithLexicon'
+
+tagBeam :: Int -> Bool -> [Int] -> IO (Maybe [Int])
+tagBeam beamWidth useLexicon = tagWith (\ws len -> tagBeam' ws len (toEnum beamWidth) (fromBool useLexicon))
+
+tagForms :: Int -> Bool -> [String] -> IO (Maybe [Int])
+tagForms beamWidth useLexicon ws = do
+    cws <- mapM newCString ws
+    css <- newArray cws
     ts <- callocArray size
-    res <- tag' css (toEnum size) ts
+    res <- tagForms' css (toEnum size) (toEnum beamWidth) (fromBool useLexicon) ts
     if toBool res then do
         tags <- peekArray size ts
         return $ Just $ map fromEnum tags
@@ -121,6 +182,79 @@ tag ws = do
     where
         size = length ws
 
+tagBatch :: Int -> Bool -> [[Int]] -> IO (Maybe [[Int]])
+tagBatch beamWidth useLexicon wss = do
+    css <- callocArray size
+    pokeArray css $ map toEnum $ concat wss
+    os <- callocArray (length offsets)
+    pokeArray os $ map toEnum offsets
+    ts <- callocArray size
+    res <- tagBatch' css os (toEnum $ length wss) (toEnum beamWidth) (fromBool useLexicon) ts
+    if toBool res then do
+        tags <- peekArray size ts
+        return $ Just $ splitPlaces (map length wss) $ map fromEnum tags
+    else return Nothing
+    where
+        offsets = scanl (+) 0 $ map length wss
+        size = last offsets
+        splitPlaces [] _ = []
+        splitPlaces (l:ls) xs = let (h, t) = splitAt l xs in h : splitPlaces ls t
+
+tagPosteriors :: Int -> Bool -> [Int] -> IO (Maybe [[(Int, Float)]])
+tagPosteriors k useLexicon ws = do
+    css <- callocArray len
+    pokeArray css $ map toEnum ws
+    ts <- callocArray size
+    ps <- callocArray size
+    res <- tagPosteriors' css (toEnum len) (toEnum k) (fromBool useLexicon) ts ps
+    if toBool res then do
+        tags <- peekArray size ts
+        probs <- peekArray size ps
+        return $ Just $ chunks $ zip (map fromEnum tags) (map realToFrac probs)
+    else return Nothing
+    where
+        len = length ws
+        size = len * k
+        chunks [] = []
+        chunks xs = let (h, t) = splitAt k xs in h : chunks t
+
+tagNBest :: Int -> Bool -> [Int] -> IO (Maybe [([Int], Float)])
+tagNBest k useLexicon ws = do
+    css <- callocArray len
+    pokeArray css $ map toEnum ws
+    ts <- callocArray (len * k)
+    ss <- callocArray k
+    fs <- new 0
+    res <- tagNBest' css (toEnum len) (toEnum k) (fromBool useLexicon) ts ss fs
+    if toBool res then do
+        found <- fromEnum <$> peek fs
+        tags <- peekArray (len * found) ts
+        scores <- peekArray found ss
+        return $ Just $ zip (chunks found $ map fromEnum tags) (map realToFrac scores)
+    else return Nothing
+    where
+        len = length ws
+        chunks 0 _ = []
+        chunks n xs = let (h, t) = splitAt len xs in h : chunks (n - 1) t
+
+pushWord :: Bool -> Int -> IO (Maybe [Int])
+pushWord useLexicon w = streamWith $ pushWord' (toEnum w) (fromBool useLexicon)
+
+flushWords :: IO (Maybe [Int])
+flushWords = streamWith flushWords'
+
+streamWith :: (Ptr CULong -> Ptr CULong -> IO CBool) -> IO (Maybe [Int])
+streamWith f = do
+    size <- fromEnum <$> tagStreamLatency'
+    ts <- callocArray size
+    ds <- new 0
+    res <- f ts ds
+    if toBool res then do
+        decided <- fromEnum <$> peek ds
+        tags <- peekArray decided ts
+        return $ Just $ map fromEnum tags
+    else return Nothing
+
 getCompoundPOSTag :: Int -> IO (Maybe [Int])
 getCompoundPOSTag = getCompoundTag getCompoundPOSTag' 32
 
@@ -134,11 +268,17 @@ index2FeatureValue :: Int -> IO (Maybe String)
 index2FeatureValue = index2string index2FeatureValue'
 
 buildDependencyTree :: [Int] -> IO (Maybe [Int])
-buildDependencyTree ss = do
+buildDependencyTree = buildDependencyTreeBy buildDependencyTree'
+
+buildDependencyTreeWith :: Int -> [Int] -> IO (Maybe [Int])
+buildDependencyTreeWith solver = buildDependencyTreeBy (\ts size es -> buildDependencyTreeWith' ts size (toEnum solver) es)
+
+buildDependencyTreeBy :: (Ptr CULong -> CULong -> Ptr CULong -> IO CBool) -> [Int] -> IO (Maybe [Int])
+buildDependencyTreeBy build ss = do
     ts <- callocArray size
     pokeArray ts $ map toEnum ss
     es <- callocArray (3 * size)
-    res <- buildDependencyTree' ts (toEnum size) es
+    res <- build ts (toEnum size) es
     if toBool res then do
         edges <- peekArray (3 * size) es
         return $ Just $ map fromEnum edges
@@ -146,6 +286,58 @@ buildDependencyTree ss = do
     where
         size = length ss
 
+buildDependencyTrees :: [[Int]] -> IO (Maybe [[Int]])
+buildDependencyTrees tss = do
+    ts <- callocArray size
+    pokeArray ts $ map toEnum $ concat tss
+    os <- callocArray (length offsets)
+    pokeArray os $ map toEnum offsets
+    es <- callocArray (3 * size)
+    res <- buildDependencyTrees' ts os (toEnum $ length tss) es
+    if toBool res then do
+        edges <- peekArray (3 * size) es
+        return $ Just $ splitPlaces (map ((* 3) . length) tss) $ map fromEnum edges
+    else return Nothing
+    where
+        offsets = scanl (+) 0 $ map length tss
+        size = last offsets
+        splitPlaces [] _ = []
+        splitPlaces (l:ls) xs = let (h, t) = splitAt l xs in h : splitPlaces ls t
+
+buildDependencyTreeNBest :: Int -> [Int] -> IO (Maybe [([Int], Float)])
+buildDependencyTreeNBest k ss = do
+    ts <- callocArray size
+    pokeArray ts $ map toEnum ss
+    es <- callocArray (3 * size * k)
+    scs <- callocArray k
+    fs <- new 0
+    res <- buildDependencyTreeNBest' ts (toEnum size) (toEnum k) es scs fs
+    if toBool res then do
+        found <- fromEnum <$> peek fs
+        edges <- peekArray (3 * size * found) es
+        scores <- peekArray found scs
+        return $ Just $ zip (chunks found $ map fromEnum edges) (map realToFrac scores)
+    else return Nothing
+    where
+        size = length ss
+        chunks 0 _ = []
+        chunks n xs = let (h, t) = splitAt (3 * size) xs in h : chunks (n - 1) t
+
+analyze :: Int -> Bool -> [Int] -> IO (Maybe ([Int], [Int]))
+analyze beamWidth useLexicon ws = do
+    css <- callocArray size
+    pokeArray css $ map toEnum ws
+    ts <- callocArray size
+    es <- callocArray (3 * size)
+    res <- analyze' css (toEnum size) (toEnum beamWidth) (fromBool useLexicon) ts es
+    if toBool res then do
+        tags <- peekArray size ts
+        edges <- peekArray (3 * size) es
+        return $ Just (map fromEnum tags, map fromEnum edges)
+    else return Nothing
+    where
+        size = length ws
+
 getCompoundDeprelTag :: Int -> IO (Maybe [Int])
 getCompoundDeprelTag = getCompoundTag getCompoundDeprelTag' 32
 
@@ -157,6 +349,19 @@ index2dependencyRelationModifier = index2string index2dependencyRelationModifier
 
 -- -------------------------------------------------------------
 
+tagWith :: (Ptr CULong -> CULong -> Ptr CULong -> IO CBool) -> [Int] -> IO (Maybe [Int])
+tagWith f ws = do
+    css <- callocArray size
+    pokeArray css $ map toEnum ws
+    ts <- callocArray size
+    res <- f css (toEnum size) ts
+    if toBool res then do
+        tags <- peekArray size ts
+        return $ Just $ map fromEnum tags
+    else return Nothing
+    where
+        size = length ws
+
 getCompoundTag :: (CULong -> Ptr CULong -> Ptr CULong -> IO CBool) -> Int -> Int -> IO (Maybe [Int])
 getCompoundTag f size t = do
     plen <- new (toEnum size)
@@ -117,3 +117,55 @@ TEST(DSUTest, UnionAll)
 
     EXPECT_EQ(dsu.find(DSU<size_t>::notFound), DSU<size_t>::notFound);
 }
+
+TEST(DSUTest, Rollback)
+{
+    constexpr size_t N = 1336;
+
+    RollbackDSU<size_t> dsu(N);
+
+    EXPECT_EQ(dsu.size(), N);
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        EXPECT_EQ(dsu.find(i), i);
+    }
+
+    for (size_t i = 0; i < N; i += 2)
+    {
+        EXPECT_TRUE(dsu.makeUnion(i, i + 1));
+    }
+
+    const size_t time = dsu.time();
+    EXPECT_EQ(time, N / 2);
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        dsu.makeUnion(0, i);
+    }
+    EXPECT_FALSE(dsu.makeUnion(1, N - 1));
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        EXPECT_EQ(dsu.find(i), dsu.find(0));
+    }
+
+    dsu.rollback(time);
+    EXPECT_EQ(dsu.time(), time);
+
+    for (size_t i = 0; i < N; i += 2)
+    {
+        EXPECT_EQ(dsu.find(i), dsu.find(i + 1));
+        if (i + 2 < N)
+        {
+            EXPECT_NE(dsu.find(i), dsu.find(i + 2));
+        }
+    }
+
+    dsu.rollback(0);
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        EXPECT_EQ(dsu.find(i), i);
+    }
+}
@@ -0,0 +1,354 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <filesystem>
+#include <vector>
+
+#include "../ML/DepRelStatistics.h"
+#include "../Engine/ThreadPool.h"
+
+static void trainRandom(DepRelStatistics& drStat, const TagsCollection& tc, DepRelsCollection& drc, TagId tagsNum)
+{
+    for (SimpleTagId rel = 0; rel < 4; ++rel)
+    {
+        for (const bool headBefore: {false, true})
+        {
+            DepRelTag tag;
+            tag.depRel = rel;
+            tag.headBefore = headBefore;
+            drc.addDepRel(tag);
+        }
+    }
+
+    drStat.resize(drc.depRelsSize(), tagsNum);
+
+    for (size_t s = 0; s < 200; ++s)
+    {
+        Sentence sentence;
+        sentence.words.resize(2 + std::rand() % 8);
+        for (size_t i = 0; i < sentence.words.size(); ++i)
+        {
+            auto& word = sentence.words[i];
+            word.tags = std::rand() % tagsNum;
+            word.depRel = std::rand() % drc.depRelsSize();
+            do
+            {
+                word.depHead = std::rand() % (sentence.words.size() + 1);
+            }
+            while (word.depHead == i + 1);
+        }
+        drStat.processSentence(tc, drc, sentence);
+    }
+
+    drStat.normalize(0.5);
+}
+
+TEST(DepRelStatisticsTest, BestLabelGraph)
+{
+    const TagId tagsNum = 6;
+
+    TagsCollection tc;
+    DepRelsCollection drc;
+    DepRelStatistics drStat;
+    trainRandom(drStat, tc, drc, tagsNum);
+
+    for (size_t t = 0; t < 50; ++t)
+    {
+        std::vector<TagId> tags(1 + std::rand() % 10);
+        for (auto& tag: tags)
+        {
+            tag = std::rand() % tagsNum;
+        }
+
+        const auto labeled = drStat.extractGraph(tc, drc, tags, false);
+        const auto bestLabel = drStat.extractGraph(tc, drc, tags, true);
+
+        ASSERT_TRUE(labeled);
+        ASSERT_TRUE(bestLabel);
+
+        // Every word gets at most one head, labels go in the direction of their arcs
+        std::vector<size_t> heads(tags.size() + 1, 0);
+        for (const auto& e: *bestLabel)
+        {
+            ASSERT_GT(e.dest, 0);
+            ASSERT_LE(e.dest, tags.size());
+            EXPECT_EQ(++heads[e.dest], 1u);
+
+            const auto drTag = drc.getDependencyRelationTag(e.label);
+            ASSERT_TRUE(drTag);
+            if (e.src != 0)
+            {
+                EXPECT_EQ(drTag->headBefore, e.src < e.dest);
+            }
+        }
+    }
+
+    EXPECT_FALSE(std::filesystem::exists("dr-src.dot"));
+    EXPECT_FALSE(std::filesystem::exists("dr.dot"));
+}
+
+// Arc scores of the best label graph are gathered by tag pair, the labeled graph scores every cell
+TEST(DepRelStatisticsTest, BestLabelGraphMatchesLabeled)
+{
+    const TagId tagsNum = 6;
+
+    TagsCollection tc;
+    DepRelsCollection drc;
+    DepRelStatistics drStat;
+    trainRandom(drStat, tc, drc, tagsNum);
+
+    for (size_t t = 0; t < 50; ++t)
+    {
+        std::vector<TagId> tags(1 + std::rand() % 20);
+        for (auto& tag: tags)
+        {
+            tag = std::rand() % tagsNum;
+        }
+
+        const auto labeled = drStat.extractGraph(tc, drc, tags, false, TreeSolver::Tarjan);
+        const auto bestLabel = drStat.extractGraph(tc, drc, tags, true, TreeSolver::Tarjan);
+
+        ASSERT_TRUE(labeled);
+        ASSERT_TRUE(bestLabel);
+        ASSERT_EQ(labeled->size(), bestLabel->size());
+
+        for (size_t i = 0; i < labeled->size(); ++i)
+        {
+            EXPECT_EQ((*labeled)[i].src, (*bestLabel)[i].src);
+            EXPECT_EQ((*labeled)[i].dest, (*bestLabel)[i].dest);
+            EXPECT_EQ((*labeled)[i].label, (*bestLabel)[i].label);
+            EXPECT_EQ((*labeled)[i].weight, (*bestLabel)[i].weight);
+        }
+    }
+}
+
+TEST(DepRelStatisticsTest, SmoothedOnRead)
+{
+    DepRelsCollection drc;
+    TagsCollection tc;
+
+    const TagId depRelsNum = 3;
+    const TagId tagsNum = 1000;
+    constexpr float smoothingFactor = 0.5f;
+
+    DepRelStatistics drStat(depRelsNum, tagsNum);
+
+    // Root -> 10 -> 20 twice
+    Sentence sentence;
+    sentence.words.resize(2);
+    sentence.words[0].tags = 10;
+    sentence.words[0].depHead = 0;
+    sentence.words[0].depRel = 1;
+    sentence.words[1].tags = 20;
+    sentence.words[1].depHead = 1;
+    sentence.words[1].depRel = 2;
+
+    drStat.processSentence(tc, drc, sentence);
+    drStat.processSentence(tc, drc, sentence);
+    drStat.normalize(smoothingFactor);
+
+    EXPECT_EQ(drStat.size(), 2);
+    EXPECT_LT(drStat.bytes(), size_t(depRelsNum) * tagsNum * tagsNum * sizeof(float) / 1000);
+
+    const float logZ = std::log(2 + smoothingFactor * depRelsNum * tagsNum);
+    EXPECT_FLOAT_EQ(drStat.logProb(2, 10, 20), std::log(2 + smoothingFactor) - logZ);
+    EXPECT_FLOAT_EQ(drStat.logProb(1, drc.depRelRoot(), 10), std::log(2 + smoothingFactor) - logZ);
+    EXPECT_FLOAT_EQ(drStat.logProb(1, 10, 20), std::log(smoothingFactor) - logZ);
+
+    const float unseenLogZ = std::log(smoothingFactor * depRelsNum * tagsNum);
+    EXPECT_FLOAT_EQ(drStat.logProb(0, 5, 7), std::log(smoothingFactor) - unseenLogZ);
+}
+
+TEST(DepRelStatisticsTest, SaveLoad)
+{
+    constexpr const char* fileName = "./depRelStatistics.bin.gz";
+    const TagId tagsNum = 6;
+
+    TagsCollection tc;
+    DepRelsCollection drc;
+    DepRelStatistics drStat;
+    trainRandom(drStat, tc, drc, tagsNum);
+
+    {
+        ZLibFile zfile(fileName, true);
+        EXPECT_TRUE(zfile.isOpen());
+        drStat.saveBinary(zfile);
+    }
+
+    DepRelStatistics loaded;
+
+    {
+        ZLibFile zfile(fileName, false);
+        EXPECT_TRUE(zfile.isOpen());
+        EXPECT_TRUE(loaded.loadBinary(zfile));
+    }
+
+    EXPECT_EQ(drStat, loaded);
+
+    const std::vector<TagId> tags = {0, 3, 5, 1};
+    const auto expected = drStat.extractGraph(tc, drc, tags);
+    const auto res = loaded.extractGraph(tc, drc, tags);
+    ASSERT_TRUE(expected);
+    ASSERT_TRUE(res);
+    ASSERT_EQ(expected->size(), res->size());
+    for (size_t i = 0; i < res->size(); ++i)
+    {
+        EXPECT_EQ((*expected)[i].src, (*res)[i].src);
+        EXPECT_EQ((*expected)[i].dest, (*res)[i].dest);
+        EXPECT_EQ((*expected)[i].label, (*res)[i].label);
+    }
+
+    std::remove(fileName);
+}
+
+// Rows are read without bounds checks later, so keys out of range are rejected on load
+TEST(DepRelStatisticsTest, LoadRejectsWrongKeys)
+{
+    constexpr const char* fileName = "./test-dr.bin.gz";
+
+    auto load = [&](TagId depRelsNum, TagId tagsNum, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& keys)
+    {
+        {
+            ZLibFile zfile(fileName, true);
+            EXPECT_TRUE(zfile.isOpen());
+            zfile.write(depRelsNum);
+            zfile.write(tagsNum);
+            zfile.write(0.0f);
+            zfile.write(offsets);
+            zfile.write(keys);
+            zfile.write(std::vector<float>(keys.size(), -1.0f));
+            zfile.write(std::vector<float>(tagsNum, 0.0f));
+        }
+
+        DepRelStatistics loaded;
+        ZLibFile zfile(fileName, false);
+        return loaded.loadBinary(zfile);
+    };
+
+    // Keys are (src << 16) | depRel
+    EXPECT_TRUE(load(2, 3, {0, 2, 2, 3}, {0x00000, 0x20001, 0x10000}));
+    EXPECT_FALSE(load(2, 3, {0, 2, 2, 3}, {0x00000, 0x30001, 0x10000}));
+    EXPECT_FALSE(load(2, 3, {0, 2, 2, 3}, {0x00000, 0x20002, 0x10000}));
+    EXPECT_FALSE(load(2, 3, {0, 2, 2, 3}, {0x20001, 0x00000, 0x10000}));
+    EXPECT_FALSE(load(2, 3, {0, 2, 3}, {0x00000, 0x20001, 0x10000}));
+    EXPECT_FALSE(load(2, 3, {0, 2, 2, 4}, {0x00000, 0x20001, 0x10000}));
+
+    std::remove(fileName);
+}
+
+TEST(DepRelStatisticsTest, ShardedCountsMatchSerial)
+{
+    const TagId tagsNum = 9;
+
+    TagsCollection tc;
+    DepRelsCollection drc;
+    for (SimpleTagId rel = 0; rel < 3; ++rel)
+    {
+        DepRelTag tag;
+        tag.depRel = rel;
+        drc.addDepRel(tag);
+    }
+
+    std::vector<Sentence> sentences(500);
+    for (auto& sentence: sentences)
+    {
+        sentence.words.resize(2 + std::rand() % 8);
+        for (size_t i = 0; i < sentence.words.size(); ++i)
+        {
+            auto& word = sentence.words[i];
+            word.tags = std::rand() % tagsNum;
+            word.depRel = std::rand() % drc.depRelsSize();
+            do
+            {
+                word.depHead = std::rand() % (sentence.words.size() + 1);
+            }
+            while (word.depHead == i + 1);
+        }
+    }
+
+    DepRelStatistics serial(drc.depRelsSize(), tagsNum, true);
+    for (const auto& sentence: sentences)
+    {
+        serial.processSentence(tc, drc, sentence);
+    }
+    serial.normalize(0.5);
+
+    ThreadPool pool(4);
+    DepRelStatistics sharded(drc.depRelsSize(), tagsNum, true);
+    std::vector<DepRelStatistics::Counts> counts(pool.size(), DepRelStatistics::Counts(tagsNum));
+    pool.parallelFor(sentences.size(), [&](size_t begin, size_t end, size_t worker)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            sharded.countSentence(drc, sentences[i], counts[worker]);
+        }
+    });
+    for (const auto& shard: counts)
+    {
+        sharded.merge(shard);
+    }
+    sharded.normalize(0.5);
+
+    EXPECT_EQ(serial, sharded);
+
+    for (TagId dest = 0; dest < tagsNum; ++dest)
+    {
+        for (TagId dr = 0; dr < drc.depRelsSize(); ++dr)
+        {
+            EXPECT_EQ(serial.relationCount(dest, dr), sharded.relationCount(dest, dr));
+        }
+    }
+
+    DepRelStatistics withoutRelations(drc.depRelsSize(), tagsNum);
+    for (const auto& sentence: sentences)
+    {
+        withoutRelations.processSentence(tc, drc, sentence);
+    }
+    withoutRelations.normalize(0.5);
+
+    EXPECT_EQ(serial, withoutRelations);
+    EXPECT_EQ(withoutRelations.relationCount(0, 0), 0);
+}
+
+TEST(DepRelStatisticsTest, TraceSampledTrees)
+{
+    const std::string directory = "./trace-test";
+    const TagId tagsNum = 6;
+
+    TagsCollection tc;
+    DepRelsCollection drc;
+    DepRelStatistics drStat;
+    trainRandom(drStat, tc, drc, tagsNum);
+
+    const std::vector<TagId> tags = {0, 3, 5, 1};
+
+    {
+        TraceSink sink(directory, 2);
+        drStat.setTraceSink(&sink);
+
+        for (size_t t = 0; t < 3; ++t)
+        {
+            EXPECT_TRUE(drStat.extractGraph(tc, drc, tags));
+        }
+
+        DepRelStatistics::Edges edges(tags.size());
+        EXPECT_TRUE(drStat.extractGraph(drc, tags, DepRelStatistics::threadWorkspace(), edges.data()));
+
+        sink.flush();
+        drStat.setTraceSink(nullptr);
+
+        EXPECT_EQ(sink.written(), 4);
+        EXPECT_EQ(sink.dropped(), 0);
+    }
+
+    for (const char* name: {"0-dr-src.dot", "0-dr.dot", "2-dr-src.dot", "2-dr.dot"})
+    {
+        EXPECT_TRUE(std::filesystem::exists(std::filesystem::path(directory) / name));
+    }
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::path(directory) / "1-dr.dot"));
+
+    std::filesystem::remove_all(directory);
+}
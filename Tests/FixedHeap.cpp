@@ -0,0 +1,30 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../Math/FixedHeap.h"
+
+TEST(FixedHeapTest, KeepsGreatest)
+{
+    for (size_t t = 0; t < 100; ++t)
+    {
+        const size_t capacity = std::rand() % 10;
+        FixedHeap<int> heap(capacity);
+
+        std::vector<int> values(std::rand() % 50);
+        for (auto& v: values)
+        {
+            v = std::rand() % 100;
+            heap.push(v);
+        }
+
+        std::sort(values.rbegin(), values.rend());
+        values.resize(std::min(capacity, values.size()));
+
+        std::vector<int> kept(heap.begin(), heap.end());
+        std::sort(kept.rbegin(), kept.rend());
+
+        EXPECT_EQ(kept, values);
+    }
+}
@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
 
 #include <fstream>
+#include <algorithm>
+#include <tuple>
 
 #include "../Math/Graph.h"
+#include "../Math/SparseGraph.h"
 
 TEST(GraphTest, CreateEmpty)
 {
@@ -49,3 +52,150 @@ TEST(GraphTest, Edges)
 
     EXPECT_EQ(g.edges().size(), 2);
 }
+
+TEST(GraphTest, Reset)
+{
+    Graph<float, size_t> g(7, 3);
+
+    g.addEdge(0, 1, 2, 0.5);
+    g.addEdge(3, 6, 0, 0.25);
+
+    g.reset(4, 1);
+
+    EXPECT_EQ(g.numVertices(), 4);
+    EXPECT_EQ(g.numLabels(), 1);
+    EXPECT_EQ(g.edges().size(), 0);
+
+    g.addEdge(3, 2, 0, 1.5);
+    g.addEdge(0, 1, 0, 2.5);
+
+    const auto edges = g.edges();
+    ASSERT_EQ(edges.size(), 2);
+    EXPECT_EQ(edges[0].src, 0);
+    EXPECT_EQ(edges[0].weight, 2.5);
+    EXPECT_EQ(edges[1].src, 3);
+    EXPECT_EQ(edges[1].dest, 2);
+
+    g.reset(9, 2);
+
+    EXPECT_EQ(g.numVertices(), 9);
+    EXPECT_EQ(g.numLabels(), 2);
+    EXPECT_EQ(g.edges().size(), 0);
+
+    g.addEdge(8, 7, 1, 3.5);
+    EXPECT_EQ(g.weight(8, 7, 1), 3.5);
+    EXPECT_EQ(g.edges().size(), 1);
+}
+
+// Both representations go through the same calls
+template<typename G>
+class GraphConceptTest : public testing::Test
+{
+};
+
+typedef testing::Types<Graph<float, size_t>, SparseGraph<float, size_t>> GraphTypes;
+TYPED_TEST_SUITE(GraphConceptTest, GraphTypes);
+
+TYPED_TEST(GraphConceptTest, AddRemove)
+{
+    TypeParam g(5, 2);
+
+    g.addEdge(3, 1, 1, 0.5);
+    g.addEdge(0, 1, 0, 0.25);
+    g.addEdge(3, 1, 0, 1.5);
+    g.addEdge(2, 4, 1, 2.5);
+
+    EXPECT_EQ(g.weight(3, 1, 1), 0.5);
+    EXPECT_EQ(g.weight(2, 4, 1), 2.5);
+    EXPECT_FALSE(TypeParam::isEdge(g.weight(1, 3, 1)));
+    EXPECT_EQ(g.edges().size(), 4);
+
+    g.addEdge(3, 1, 1, 3.5);
+    EXPECT_EQ(g.weight(3, 1, 1), 3.5);
+    EXPECT_EQ(g.edges().size(), 4);
+
+    g.removeEdge(3, 1, 1);
+    g.removeEdge(4, 4, 0);
+    EXPECT_FALSE(TypeParam::isEdge(g.weight(3, 1, 1)));
+    EXPECT_EQ(g.edges().size(), 3);
+
+    g.reset(3, 1);
+    EXPECT_EQ(g.numVertices(), 3);
+    EXPECT_EQ(g.numLabels(), 1);
+    EXPECT_EQ(g.edges().size(), 0);
+}
+
+TYPED_TEST(GraphConceptTest, ForEachIncoming)
+{
+    TypeParam g(4, 3);
+
+    g.addEdge(2, 1, 2, 1);
+    g.addEdge(0, 1, 1, 2);
+    g.addEdge(2, 1, 0, 3);
+    g.addEdge(3, 2, 0, 4);
+
+    std::vector<typename TypeParam::Edge> in;
+    g.forEachIncoming(1, [&](size_t src, size_t l, float& w)
+    {
+        in.push_back({src, 1, l, w});
+        w += 10;
+    });
+
+    ASSERT_EQ(in.size(), 3);
+    EXPECT_EQ(in[0].src, 0);
+    EXPECT_EQ(in[0].label, 1);
+    EXPECT_EQ(in[1].src, 2);
+    EXPECT_EQ(in[1].label, 0);
+    EXPECT_EQ(in[2].src, 2);
+    EXPECT_EQ(in[2].label, 2);
+
+    EXPECT_EQ(g.weight(2, 1, 0), 13);
+    EXPECT_EQ(g.weight(3, 2, 0), 4);
+}
+
+TEST(GraphTest, SparseMatchesDense)
+{
+    constexpr size_t vertices = 30;
+    constexpr size_t labels = 3;
+
+    Graph<float, size_t> dense(vertices, labels);
+    SparseGraph<float, size_t> sparse(vertices, labels);
+
+    for (size_t i = 0; i < 500; ++i)
+    {
+        const size_t src = rand() % vertices;
+        const size_t dest = rand() % vertices;
+        const size_t l = rand() % labels;
+        const float w = rand() % 100;
+
+        if (rand() % 4 == 0)
+        {
+            dense.removeEdge(src, dest, l);
+            sparse.removeEdge(src, dest, l);
+        }
+        else
+        {
+            dense.addEdge(src, dest, l, w);
+            sparse.addEdge(src, dest, l, w);
+        }
+    }
+
+    auto byDest = [](const auto& a, const auto& b)
+    {
+        return std::tie(a.dest, a.src, a.label) < std::tie(b.dest, b.src, b.label);
+    };
+
+    auto denseEdges = dense.edges();
+    std::sort(denseEdges.begin(), denseEdges.end(), byDest);
+    const auto sparseEdges = sparse.edges();
+
+    ASSERT_EQ(denseEdges.size(), sparseEdges.size());
+    EXPECT_EQ(sparse.numEdges(), sparseEdges.size());
+    for (size_t i = 0; i < denseEdges.size(); ++i)
+    {
+        EXPECT_EQ(denseEdges[i].src, sparseEdges[i].src);
+        EXPECT_EQ(denseEdges[i].dest, sparseEdges[i].dest);
+        EXPECT_EQ(denseEdges[i].label, sparseEdges[i].label);
+        EXPECT_EQ(denseEdges[i].weight, sparseEdges[i].weight);
+    }
+}
@@ -0,0 +1,1029 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "../ML/HMM.h"
+#include "../ML/StreamingViterbi.h"
+#include "../ML/TrigramHMM.h"
+#include "../Math/MaxPlus.h"
+
+typedef HMM<float, uint16_t, uint32_t> TestHMM;
+typedef TrigramHMM<float, uint16_t, uint32_t> TestTrigramHMM;
+
+// Heap allocations of the current thread, to check that decoding with a workspace does not allocate
+static thread_local size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+static void trainRandom(TestHMM& hmm, uint16_t hiddenStates, uint32_t emissions, size_t samples)
+{
+    hmm.resize(hiddenStates, emissions);
+
+    for (size_t i = 0; i < samples; ++i)
+    {
+        hmm.addHiddenState2HiddenState(std::rand() % hiddenStates, std::rand() % hiddenStates);
+        hmm.addHiddenState2Emission(std::rand() % hiddenStates, std::rand() % emissions);
+    }
+
+    hmm.normalize(0.1);
+}
+
+static std::vector<uint32_t> randomSentence(uint32_t emissions)
+{
+    std::vector<uint32_t> sentence(1 + std::rand() % 30);
+    for (auto& e: sentence)
+    {
+        e = std::rand() % emissions;
+    }
+    return sentence;
+}
+
+// Straightforward Viterbi used as a reference for the vectorized one
+static std::vector<uint16_t> referencePredict(const TestHMM& hmm, uint16_t serviceTag, const std::vector<uint32_t>& emissions, const std::vector<TestHMM::States>& allowed = {})
+{
+    auto isAllowed = [&](size_t i, uint16_t hs)
+    {
+        return allowed.empty() || allowed[i].empty() || std::find(allowed[i].begin(), allowed[i].end(), hs) != allowed[i].end();
+    };
+
+    const uint16_t hsNum = hmm.numHiddenStates();
+    const size_t seqSize = emissions.size();
+
+    std::vector<std::vector<float>> prob(seqSize, std::vector<float>(hsNum, -std::numeric_limits<float>::infinity()));
+    std::vector<std::vector<uint16_t>> prev(seqSize, std::vector<uint16_t>(hsNum, 0));
+
+    for (uint16_t hsTo = 0; hsTo < hsNum; ++hsTo)
+    {
+        if (!isAllowed(0, hsTo))
+        {
+            continue;
+        }
+        prob[0][hsTo] = hmm.transition(serviceTag, hsTo) + hmm.emission(hsTo, emissions[0]);
+    }
+
+    for (size_t i = 1; i < seqSize; ++i)
+    {
+        for (uint16_t hsTo = 0; hsTo < hsNum; ++hsTo)
+        {
+            if (!isAllowed(i, hsTo))
+            {
+                continue;
+            }
+            for (uint16_t hsFrom = 0; hsFrom < hsNum; ++hsFrom)
+            {
+                float p = prob[i - 1][hsFrom] + hmm.transition(hsFrom, hsTo) + hmm.emission(hsTo, emissions[i]);
+                if (p > prob[i][hsTo])
+                {
+                    prob[i][hsTo] = p;
+                    prev[i][hsTo] = hsFrom;
+                }
+            }
+        }
+    }
+
+    std::vector<uint16_t> res(seqSize, serviceTag);
+    float pMax = -std::numeric_limits<float>::infinity();
+    for (uint16_t hsFrom = 0; hsFrom < hsNum; ++hsFrom)
+    {
+        float p = prob[seqSize - 1][hsFrom] + hmm.transition(hsFrom, serviceTag);
+        if (p > pMax)
+        {
+            pMax = p;
+            res[seqSize - 1] = hsFrom;
+        }
+    }
+
+    for (size_t i = seqSize - 1; i != 0; --i)
+    {
+        res[i - 1] = prev[i][res[i]];
+    }
+
+    return res;
+}
+
+TEST(HMMTest, MaxPlusKernels)
+{
+    const std::vector<SIMDLevel> levels = {SIMDLevel::AVX2, SIMDLevel::AVX512};
+
+    for (size_t t = 0; t < 1000; ++t)
+    {
+        const size_t n = std::rand() % 100;
+        std::vector<float> a(n);
+        std::vector<float> b(n);
+
+        for (size_t j = 0; j < n; ++j)
+        {
+            // Small integers make ties frequent, so tie breaking is checked too
+            a[j] = std::rand() % 5 == 0 ? -std::numeric_limits<float>::infinity() : float(std::rand() % 7);
+            b[j] = float(std::rand() % 7);
+        }
+
+        const float c = float(std::rand() % 3);
+
+        float expected = 0;
+        const size_t expectedIx = maxPlus(SIMDLevel::Scalar, a.data(), b.data(), c, n, expected);
+
+        for (const auto level: levels)
+        {
+            if (level > simdLevel())
+            {
+                continue;
+            }
+
+            float res = 0;
+            EXPECT_EQ(maxPlus(level, a.data(), b.data(), c, n, res), expectedIx);
+            EXPECT_EQ(res, expected);
+        }
+    }
+}
+
+TEST(HMMTest, SparseEmissionsMatchDense)
+{
+    constexpr const char* fileName = "./emissions.bin.gz";
+
+    for (size_t t = 0; t < 20; ++t)
+    {
+        const uint16_t hiddenStates = 1 + std::rand() % 30;
+        const uint32_t emissions = 1 + std::rand() % 200;
+
+        Tensor<float, uint32_t, 2> dense(0, {hiddenStates, emissions});
+        std::unordered_map<uint64_t, uint32_t> counts;
+        SparseEmissions<float, uint16_t, uint32_t> sparse;
+        sparse.resize(hiddenStates, emissions);
+
+        for (size_t i = 0; i < 5u * emissions; ++i)
+        {
+            const uint16_t hs = std::rand() % hiddenStates;
+            const uint32_t es = std::rand() % emissions;
+            ++dense.at(hs, es);
+            ++counts[uint64_t(es) * hiddenStates + hs];
+        }
+
+        dense.normalizeLog(0.1, 0);
+        sparse.normalize(counts, 0.1);
+
+        EXPECT_LE(sparse.nonZeros(), 5u * emissions);
+
+        std::vector<float> row(hiddenStates);
+        for (uint32_t es = 0; es < emissions; ++es)
+        {
+            sparse.fill(es, row.data());
+            for (uint16_t hs = 0; hs < hiddenStates; ++hs)
+            {
+                EXPECT_NEAR(sparse.at(hs, es), dense.at(hs, es), 1e-5);
+                EXPECT_EQ(row[hs], sparse.at(hs, es));
+            }
+        }
+
+        {
+            ZLibFile zfile(fileName, true);
+            sparse.saveBinary(zfile);
+        }
+
+        SparseEmissions<float, uint16_t, uint32_t> loaded;
+        {
+            ZLibFile zfile(fileName, false);
+            EXPECT_TRUE(loaded.loadBinary(zfile));
+        }
+
+        EXPECT_EQ(sparse, loaded);
+    }
+
+    std::remove(fileName);
+}
+
+TEST(HMMTest, MergedCountsAreBitIdentical)
+{
+    for (size_t t = 0; t < 10; ++t)
+    {
+        const uint16_t hiddenStates = 1 + std::rand() % 30;
+        const uint32_t emissions = 1 + std::rand() % 200;
+
+        std::vector<std::pair<uint16_t, uint32_t>> samples(std::rand() % 5000);
+        for (auto& [hs, es]: samples)
+        {
+            hs = std::rand() % hiddenStates;
+            es = std::rand() % emissions;
+        }
+
+        TestHMM serial(hiddenStates, emissions);
+        TestTrigramHMM serial3;
+        serial3.resize(hiddenStates);
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            serial.addHiddenState2HiddenState(samples[i].first, samples[(i + 1) % samples.size()].first);
+            serial.addHiddenState2Emission(samples[i].first, samples[i].second);
+            serial3.addHiddenStates(samples[i].first, samples[(i + 1) % samples.size()].first, samples[(i + 2) % samples.size()].first);
+        }
+        serial.normalize(0.1);
+        serial3.normalize(0.1);
+
+        // Shards are filled out of order and merged in reverse
+        std::vector<TestHMM::Counts> shards(1 + std::rand() % 8, TestHMM::Counts(hiddenStates));
+        std::vector<TestTrigramHMM::Counts> shards3(shards.size(), TestTrigramHMM::Counts(hiddenStates));
+        for (size_t i = samples.size(); i != 0; --i)
+        {
+            const size_t j = i - 1;
+            const size_t shard = std::rand() % shards.size();
+            shards[shard].addHiddenState2HiddenState(samples[j].first, samples[(j + 1) % samples.size()].first);
+            shards[shard].addHiddenState2Emission(samples[j].first, samples[j].second);
+            shards3[shard].addHiddenStates(samples[j].first, samples[(j + 1) % samples.size()].first, samples[(j + 2) % samples.size()].first);
+        }
+
+        TestHMM merged(hiddenStates, emissions);
+        TestTrigramHMM merged3;
+        merged3.resize(hiddenStates);
+        for (size_t i = shards.size(); i != 0; --i)
+        {
+            merged.merge(shards[i - 1]);
+            merged3.merge(shards3[i - 1]);
+        }
+        merged.normalize(0.1);
+        merged3.normalize(0.1);
+
+        EXPECT_EQ(serial, merged);
+        EXPECT_EQ(serial3, merged3);
+    }
+}
+
+TEST(HMMTest, RenormalizeMatchesFullNormalization)
+{
+    constexpr const char* fileName = "./hmm.bin.gz";
+
+    for (size_t t = 0; t < 10; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 30;
+        const uint32_t emissions = 2 + std::rand() % 200;
+
+        // Second batch may use one more hidden state and emission
+        std::vector<std::pair<uint16_t, uint32_t>> samples(1 + std::rand() % 3000);
+        const size_t split = std::rand() % samples.size();
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            samples[i].first = std::rand() % (i < split ? hiddenStates - 1 : hiddenStates);
+            samples[i].second = std::rand() % (i < split ? emissions - 1 : emissions);
+        }
+
+        auto add = [&](TestHMM& hmm, TestTrigramHMM& hmm3, size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                hmm.addHiddenState2HiddenState(samples[i].first, samples[(i + 1) % end].first);
+                hmm.addHiddenState2Emission(samples[i].first, samples[i].second);
+                hmm3.addHiddenStates(samples[i].first, samples[(i + 1) % end].first, samples[(i + 2) % end].first);
+            }
+        };
+
+        TestHMM full(hiddenStates, emissions);
+        TestTrigramHMM full3;
+        full3.resize(hiddenStates);
+        add(full, full3, 0, split);
+        add(full, full3, split, samples.size());
+        full.normalize(0.1);
+        full3.normalize(0.1);
+
+        {
+            TestHMM first(hiddenStates - 1, emissions - 1);
+            TestTrigramHMM first3;
+            first3.resize(hiddenStates - 1);
+            add(first, first3, 0, split);
+            first.normalize(0.1);
+            first3.normalize(0.1);
+
+            ZLibFile zfile(fileName, true);
+            first.saveBinary(zfile);
+            first3.saveBinary(zfile);
+        }
+
+        TestHMM incremental;
+        TestTrigramHMM incremental3;
+        {
+            ZLibFile zfile(fileName, false);
+            EXPECT_TRUE(incremental.loadBinary(zfile));
+            EXPECT_TRUE(incremental3.loadBinary(zfile));
+        }
+
+        incremental.grow(hiddenStates, emissions);
+        incremental3.grow(hiddenStates);
+        add(incremental, incremental3, split, samples.size());
+        incremental.renormalize();
+        incremental3.renormalize();
+
+        EXPECT_EQ(incremental, full);
+        EXPECT_EQ(incremental.getCounts(), full.getCounts());
+        EXPECT_EQ(incremental3, full3);
+
+        // Only emissions already seen, so sparse layout is kept and just dirty rows are updated
+        const size_t repeat = std::rand() % samples.size();
+        full.addHiddenState2Emission(samples[repeat].first, samples[repeat].second);
+        full.addHiddenState2HiddenState(samples[repeat].first, samples[repeat].first);
+        incremental.addHiddenState2Emission(samples[repeat].first, samples[repeat].second);
+        incremental.addHiddenState2HiddenState(samples[repeat].first, samples[repeat].first);
+        full.normalize(0.1);
+        incremental.renormalize();
+
+        EXPECT_EQ(incremental, full);
+
+        // New emission with the same hidden states keeps the normalized transitions
+        full.grow(hiddenStates, emissions + 1);
+        incremental.grow(hiddenStates, emissions + 1);
+        full.addHiddenState2Emission(samples[repeat].first, emissions);
+        incremental.addHiddenState2Emission(samples[repeat].first, emissions);
+        full.normalize(0.1);
+        incremental.renormalize();
+
+        EXPECT_EQ(incremental, full);
+    }
+
+    std::remove(fileName);
+}
+
+TEST(HMMTest, PredictMatchesReference)
+{
+    for (size_t t = 0; t < 20; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 70;
+        const uint32_t emissions = 1 + std::rand() % 50;
+
+        TestHMM hmm;
+        trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+        for (size_t s = 0; s < 10; ++s)
+        {
+            const auto sentence = randomSentence(emissions);
+            EXPECT_EQ(hmm.predict(0, sentence), referencePredict(hmm, 0, sentence));
+        }
+    }
+}
+
+TEST(HMMTest, PredictWithWorkspaceDoesNotAllocate)
+{
+    const uint16_t hiddenStates = 40;
+    const uint32_t emissions = 30;
+
+    TestHMM hmm;
+    trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+    std::vector<std::vector<uint32_t>> sentences(50);
+    std::vector<std::vector<TestHMM::States>> allowed(sentences.size());
+    for (size_t s = 0; s < sentences.size(); ++s)
+    {
+        sentences[s] = randomSentence(emissions);
+        allowed[s].resize(sentences[s].size());
+        for (auto& states: allowed[s])
+        {
+            for (uint16_t hs = 0; hs < hiddenStates; hs += 1 + std::rand() % 5)
+            {
+                states.push_back(hs);
+            }
+        }
+    }
+
+    TestHMM::DecodeWorkspace workspace;
+    std::vector<uint16_t> result;
+
+    // Grows the buffers to the longest sentence
+    std::vector<uint32_t> longest(30, 0);
+    ASSERT_TRUE(hmm.predict(0, longest, nullptr, nullptr, workspace, result));
+    std::vector<TestHMM::States> longestAllowed(longest.size(), TestHMM::States(hiddenStates));
+    for (auto& states: longestAllowed)
+    {
+        std::iota(states.begin(), states.end(), 0);
+    }
+    ASSERT_TRUE(hmm.predict(0, longest, &longestAllowed, nullptr, workspace, result));
+
+    for (size_t s = 0; s < sentences.size(); ++s)
+    {
+        const size_t before = allocations;
+        ASSERT_TRUE(hmm.predict(0, sentences[s], nullptr, nullptr, workspace, result));
+        EXPECT_EQ(allocations, before);
+        EXPECT_EQ(result, hmm.predict(0, sentences[s]));
+
+        const size_t beforeAllowed = allocations;
+        ASSERT_TRUE(hmm.predict(0, sentences[s], &allowed[s], nullptr, workspace, result));
+        EXPECT_EQ(allocations, beforeAllowed);
+        EXPECT_EQ(result, referencePredict(hmm, 0, sentences[s], allowed[s]));
+    }
+
+    const std::vector<TestHMM::States> wrongSize(sentences[0].size() + 1);
+    EXPECT_FALSE(hmm.predict(0, sentences[0], &wrongSize, nullptr, workspace, result));
+    EXPECT_TRUE(result.empty());
+}
+
+TEST(HMMTest, PredictEmpty)
+{
+    TestHMM hmm;
+    trainRandom(hmm, 5, 5, 10);
+
+    EXPECT_TRUE(hmm.predict(0, {}).empty());
+}
+
+TEST(HMMTest, PredictWithAllowedStates)
+{
+    for (size_t t = 0; t < 20; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 70;
+        const uint32_t emissions = 1 + std::rand() % 50;
+
+        TestHMM hmm;
+        trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+        for (size_t s = 0; s < 10; ++s)
+        {
+            const auto sentence = randomSentence(emissions);
+
+            std::vector<TestHMM::States> allowed(sentence.size());
+            for (auto& states: allowed)
+            {
+                // Some positions stay unrestricted
+                for (uint16_t hs = 0; hs < hiddenStates && std::rand() % 4 != 0; ++hs)
+                {
+                    if (std::rand() % 3 == 0)
+                    {
+                        states.push_back(hs);
+                    }
+                }
+            }
+
+            const auto res = hmm.predict(0, sentence, allowed);
+            EXPECT_EQ(res, referencePredict(hmm, 0, sentence, allowed));
+
+            for (size_t i = 0; i < res.size(); ++i)
+            {
+                EXPECT_TRUE(allowed[i].empty() || std::find(allowed[i].begin(), allowed[i].end(), res[i]) != allowed[i].end());
+            }
+
+            EXPECT_EQ(hmm.predict(0, sentence, std::vector<TestHMM::States>(sentence.size())), hmm.predict(0, sentence));
+
+            // Overrides equal to the model emissions change nothing
+            TestHMM::EmissionOverrides overrides(sentence.size());
+            const size_t i = std::rand() % sentence.size();
+            overrides[i].resize(hiddenStates);
+            hmm.emissionRow(sentence[i], overrides[i].data());
+            EXPECT_EQ(hmm.predict(0, sentence, allowed, &overrides), res);
+        }
+    }
+}
+
+TEST(HMMTest, PosteriorsMatchEnumeration)
+{
+    for (size_t t = 0; t < 20; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 4;
+        const uint32_t emissions = 1 + std::rand() % 10;
+
+        TestHMM hmm;
+        trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+        for (size_t s = 0; s < 10; ++s)
+        {
+            std::vector<uint32_t> sentence(1 + std::rand() % 4);
+            for (auto& e: sentence)
+            {
+                e = std::rand() % emissions;
+            }
+
+            std::vector<TestHMM::States> allowed(sentence.size());
+            for (auto& states: allowed)
+            {
+                for (uint16_t hs = 0; hs < hiddenStates && std::rand() % 2 == 0; ++hs)
+                {
+                    states.push_back(hs);
+                }
+            }
+
+            auto isAllowed = [&](size_t i, uint16_t hs)
+            {
+                return allowed[i].empty() || std::find(allowed[i].begin(), allowed[i].end(), hs) != allowed[i].end();
+            };
+
+            // Marginals of all allowed paths
+            std::vector<std::vector<double>> expected(sentence.size(), std::vector<double>(hiddenStates, 0));
+            double total = 0;
+            std::vector<uint16_t> path(sentence.size(), 0);
+            while (true)
+            {
+                bool possible = true;
+                double score = hmm.transition(0, path[0]) + hmm.emission(path[0], sentence[0]);
+                for (size_t i = 0; i < path.size(); ++i)
+                {
+                    possible = possible && isAllowed(i, path[i]);
+                    if (i != 0)
+                    {
+                        score += hmm.transition(path[i - 1], path[i]) + hmm.emission(path[i], sentence[i]);
+                    }
+                }
+                score += hmm.transition(path.back(), 0);
+
+                if (possible)
+                {
+                    total += std::exp(score);
+                    for (size_t i = 0; i < path.size(); ++i)
+                    {
+                        expected[i][path[i]] += std::exp(score);
+                    }
+                }
+
+                size_t i = 0;
+                while (i < path.size() && ++path[i] == hiddenStates)
+                {
+                    path[i++] = 0;
+                }
+                if (i == path.size())
+                {
+                    break;
+                }
+            }
+
+            const size_t k = 1 + std::rand() % (hiddenStates + 1);
+            const auto res = hmm.posteriors(0, sentence, allowed, k);
+            ASSERT_EQ(res.size(), sentence.size() * k);
+
+            for (size_t i = 0; i < sentence.size(); ++i)
+            {
+                for (size_t j = 0; j < k; ++j)
+                {
+                    const auto& p = res[i * k + j];
+                    if (j != 0)
+                    {
+                        EXPECT_GE(res[i * k + j - 1].probability, p.probability);
+                    }
+                    if (p.probability != 0)
+                    {
+                        EXPECT_TRUE(isAllowed(i, p.state));
+                        EXPECT_NEAR(p.probability, expected[i][p.state] / total, 1e-4);
+                    }
+                }
+            }
+
+            EXPECT_EQ(hmm.posteriors(0, sentence, 1).size(), sentence.size());
+        }
+    }
+}
+
+TEST(HMMTest, QuantizedPredict)
+{
+    constexpr const char* fileName = "./quantized.bin.gz";
+
+    const uint16_t hiddenStates = 37;
+    const uint32_t emissions = 50;
+
+    for (const Storage storage: {Storage::Float16, Storage::Int8})
+    {
+        TestHMM original;
+        TestHMM quantized;
+        std::srand(7);
+        trainRandom(original, hiddenStates, emissions, 20 * hiddenStates);
+        std::srand(7);
+        trainRandom(quantized, hiddenStates, emissions, 20 * hiddenStates);
+
+        const size_t bytes = quantized.bytes();
+        EXPECT_TRUE(quantized.quantize(storage));
+        EXPECT_FALSE(quantized.quantize(storage));
+        EXPECT_EQ(quantized.getStorage(), storage);
+        EXPECT_LT(quantized.bytes(), bytes);
+
+        // Int8 log probabilities of this model span less than 10
+        const float tolerance = storage == Storage::Int8 ? 10.0f / 254 : 0.01f;
+        for (uint16_t src = 0; src < hiddenStates; ++src)
+        {
+            for (uint16_t dst = 0; dst < hiddenStates; ++dst)
+            {
+                EXPECT_NEAR(quantized.transition(src, dst), original.transition(src, dst), tolerance);
+            }
+            for (uint32_t es = 0; es < emissions; ++es)
+            {
+                EXPECT_NEAR(quantized.emission(src, es), original.emission(src, es), tolerance);
+            }
+        }
+
+        for (size_t s = 0; s < 20; ++s)
+        {
+            const auto sentence = randomSentence(emissions);
+            EXPECT_EQ(quantized.predict(0, sentence), referencePredict(quantized, 0, sentence));
+        }
+
+        {
+            ZLibFile zfile(fileName, true);
+            quantized.saveBinary(zfile);
+        }
+
+        TestHMM loaded;
+        {
+            ZLibFile zfile(fileName, false);
+            EXPECT_TRUE(loaded.loadBinary(zfile));
+        }
+
+        EXPECT_EQ(loaded, quantized);
+        EXPECT_FALSE(loaded == original);
+    }
+
+    std::remove(fileName);
+}
+
+TEST(HMMTest, NBestMatchesEnumeration)
+{
+    for (size_t t = 0; t < 20; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 4;
+        const uint32_t emissions = 1 + std::rand() % 10;
+
+        TestHMM hmm;
+        trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+        for (size_t s = 0; s < 10; ++s)
+        {
+            std::vector<uint32_t> sentence(1 + std::rand() % 5);
+            for (auto& e: sentence)
+            {
+                e = std::rand() % emissions;
+            }
+
+            std::vector<TestHMM::States> allowed(sentence.size());
+            for (auto& states: allowed)
+            {
+                for (uint16_t hs = 0; hs < hiddenStates && std::rand() % 2 == 0; ++hs)
+                {
+                    states.push_back(hs);
+                }
+            }
+
+            auto isAllowed = [&](size_t i, uint16_t hs)
+            {
+                return allowed[i].empty() || std::find(allowed[i].begin(), allowed[i].end(), hs) != allowed[i].end();
+            };
+
+            auto pathScore = [&](const std::vector<uint16_t>& path)
+            {
+                double score = hmm.transition(0, path[0]) + hmm.emission(path[0], sentence[0]) + hmm.transition(path.back(), 0);
+                for (size_t i = 1; i < path.size(); ++i)
+                {
+                    score += hmm.transition(path[i - 1], path[i]) + hmm.emission(path[i], sentence[i]);
+                }
+                return score;
+            };
+
+            // Scores of all allowed paths
+            std::vector<double> expected;
+            std::vector<uint16_t> path(sentence.size(), 0);
+            while (true)
+            {
+                bool possible = true;
+                for (size_t i = 0; i < path.size(); ++i)
+                {
+                    possible = possible && isAllowed(i, path[i]);
+                }
+
+                if (possible)
+                {
+                    expected.push_back(pathScore(path));
+                }
+
+                size_t i = 0;
+                while (i < path.size() && ++path[i] == hiddenStates)
+                {
+                    path[i++] = 0;
+                }
+                if (i == path.size())
+                {
+                    break;
+                }
+            }
+            std::sort(expected.rbegin(), expected.rend());
+
+            const size_t k = 1 + std::rand() % 12;
+            const auto res = hmm.predictNBest(0, sentence, allowed, k);
+            ASSERT_EQ(res.size(), std::min(k, expected.size()));
+
+            for (size_t p = 0; p < res.size(); ++p)
+            {
+                EXPECT_NEAR(res[p].score, expected[p], 1e-4);
+                EXPECT_NEAR(res[p].score, pathScore(res[p].states), 1e-4);
+                for (size_t i = 0; i < sentence.size(); ++i)
+                {
+                    EXPECT_TRUE(isAllowed(i, res[p].states[i]));
+                }
+                for (size_t q = 0; q < p; ++q)
+                {
+                    EXPECT_NE(res[p].states, res[q].states);
+                }
+            }
+
+            EXPECT_EQ(res[0].states, hmm.predict(0, sentence, allowed));
+        }
+    }
+}
+
+TEST(HMMTest, NBestWithWorkspaceDoesNotAllocate)
+{
+    const uint16_t hiddenStates = 30;
+    const uint32_t emissions = 30;
+
+    TestHMM hmm;
+    trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+    TestHMM::DecodeWorkspace workspace;
+    std::vector<uint16_t> paths;
+    std::vector<float> scores;
+
+    std::vector<uint32_t> longest(30, 0);
+    ASSERT_TRUE(hmm.predictNBest(0, longest, nullptr, nullptr, 5, workspace, paths, scores));
+    EXPECT_EQ(scores.size(), 5u);
+    EXPECT_TRUE(std::is_sorted(scores.rbegin(), scores.rend()));
+
+    for (size_t s = 0; s < 20; ++s)
+    {
+        const auto sentence = randomSentence(emissions);
+
+        const size_t before = allocations;
+        ASSERT_TRUE(hmm.predictNBest(0, sentence, nullptr, nullptr, 5, workspace, paths, scores));
+        EXPECT_EQ(allocations, before);
+
+        const auto res = hmm.predictNBest(0, sentence, 5);
+        ASSERT_EQ(res.size(), scores.size());
+        for (size_t p = 0; p < res.size(); ++p)
+        {
+            EXPECT_TRUE(std::equal(res[p].states.begin(), res[p].states.end(), paths.begin() + p * sentence.size()));
+            EXPECT_EQ(res[p].score, scores[p]);
+        }
+    }
+
+    EXPECT_FALSE(hmm.predictNBest(0, longest, nullptr, nullptr, 0, workspace, paths, scores));
+    EXPECT_TRUE(hmm.predictNBest(0, {}, 3).empty());
+}
+
+TEST(HMMTest, StreamingMatchesPredict)
+{
+    for (size_t t = 0; t < 10; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 40;
+        const uint32_t emissions = 1 + std::rand() % 50;
+
+        TestHMM hmm;
+        trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+        StreamingViterbi<float, uint16_t, uint32_t> stream(hmm, 0);
+        for (size_t s = 0; s < 10; ++s)
+        {
+            const auto sentence = randomSentence(emissions);
+
+            std::vector<TestHMM::States> allowed(sentence.size());
+            for (auto& states: allowed)
+            {
+                for (uint16_t hs = 0; hs < hiddenStates && std::rand() % 4 != 0; ++hs)
+                {
+                    if (std::rand() % 3 == 0)
+                    {
+                        states.push_back(hs);
+                    }
+                }
+            }
+
+            const bool restricted = s % 2 == 1;
+            const auto expected = restricted ? hmm.predict(0, sentence, allowed) : hmm.predict(0, sentence);
+
+            // Tags decided on the way are never revised
+            std::vector<uint16_t> res;
+            for (size_t i = 0; i < sentence.size(); ++i)
+            {
+                stream.push(sentence[i], restricted ? &allowed[i] : nullptr, res);
+                EXPECT_EQ(res.size() + stream.size(), i + 1);
+                EXPECT_TRUE(std::equal(res.begin(), res.end(), expected.begin()));
+            }
+            stream.flush(res);
+
+            EXPECT_EQ(res, expected);
+            EXPECT_EQ(stream.size(), 0u);
+        }
+    }
+}
+
+TEST(HMMTest, StreamingLatencyIsBounded)
+{
+    const uint16_t hiddenStates = 20;
+    const uint32_t emissions = 30;
+
+    TestHMM hmm;
+    trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+    constexpr size_t maxLatency = 3;
+    StreamingViterbi<float, uint16_t, uint32_t> stream(hmm, 0, maxLatency);
+
+    std::vector<uint16_t> res;
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        stream.push(std::rand() % emissions, nullptr, res);
+        EXPECT_LE(stream.size(), maxLatency);
+        EXPECT_EQ(res.size() + stream.size(), i + 1);
+    }
+
+    stream.flush(res);
+    EXPECT_EQ(res.size(), 10000u);
+    EXPECT_TRUE(std::all_of(res.begin(), res.end(), [&](uint16_t hs) { return hs < hiddenStates; }));
+}
+
+// A single allowed state decides every pending position, the forced one is appended on top of them
+TEST(HMMTest, StreamingAppendsAtMostLatency)
+{
+    const uint16_t hiddenStates = 20;
+    const uint32_t emissions = 30;
+
+    TestHMM hmm;
+    trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+    for (const size_t maxLatency: {1, 3, 8})
+    {
+        StreamingViterbi<float, uint16_t, uint32_t> stream(hmm, 0, maxLatency);
+
+        std::vector<uint16_t> res;
+        size_t pushed = 0;
+        size_t saturated = 0;
+        for (size_t i = 0; i < 2000; ++i)
+        {
+            const size_t before = res.size();
+            const bool full = stream.size() == maxLatency;
+
+            const TestHMM::States single {uint16_t(std::rand() % hiddenStates)};
+            stream.push(std::rand() % emissions, full ? &single : nullptr, res);
+            ++pushed;
+            saturated += full;
+
+            EXPECT_LE(res.size() - before, maxLatency);
+            EXPECT_LE(stream.size(), maxLatency);
+            EXPECT_EQ(res.size() + stream.size(), pushed);
+        }
+        EXPECT_GT(saturated, 0);
+
+        stream.flush(res);
+        EXPECT_EQ(res.size(), pushed);
+    }
+}
+
+TEST(HMMTest, EmissionFrequencies)
+{
+    TestHMM::Counts counts(3);
+    counts.addHiddenState2Emission(0, 1);
+    counts.addHiddenState2Emission(2, 1);
+    counts.addHiddenState2Emission(2, 1);
+    counts.addHiddenState2Emission(1, 4);
+    counts.addHiddenState2Emission(1, 9);
+
+    std::vector<size_t> frequencies(5, 1);
+    counts.addEmissionFrequencies(frequencies);
+    EXPECT_EQ(frequencies, std::vector<size_t>({1, 4, 1, 1, 2}));
+
+    // Frequencies follow the counts when hidden states are added
+    counts.resize(7);
+    std::fill(frequencies.begin(), frequencies.end(), 0);
+    counts.addEmissionFrequencies(frequencies);
+    EXPECT_EQ(frequencies, std::vector<size_t>({0, 3, 0, 0, 1}));
+}
+
+TEST(HMMTest, PredictBeam)
+{
+    for (size_t t = 0; t < 20; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 70;
+        const uint32_t emissions = 1 + std::rand() % 50;
+
+        TestHMM hmm;
+        trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+        for (size_t s = 0; s < 10; ++s)
+        {
+            const auto sentence = randomSentence(emissions);
+
+            // Beam wide enough to keep every state is the exact Viterbi
+            EXPECT_EQ(hmm.predictBeam(0, sentence, hiddenStates), hmm.predict(0, sentence));
+            EXPECT_EQ(hmm.predictBeam(0, sentence, 2 * hiddenStates), hmm.predict(0, sentence));
+
+            const auto res = hmm.predictBeam(0, sentence, 1 + std::rand() % 5);
+            EXPECT_EQ(res.size(), sentence.size());
+            for (const auto hs: res)
+            {
+                EXPECT_LT(hs, hiddenStates);
+            }
+        }
+    }
+}
+
+static float trigramPathScore(const TestHMM& hmm, const TestTrigramHMM& hmm3, uint16_t serviceTag, const std::vector<uint32_t>& emissions, const std::vector<uint16_t>& path)
+{
+    uint16_t hs2 = serviceTag;
+    uint16_t hs1 = serviceTag;
+    float score = 0;
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        score = score + hmm3.transition(hs2, hs1, path[i]) + hmm.emission(path[i], emissions[i]);
+        hs2 = hs1;
+        hs1 = path[i];
+    }
+    return score + hmm3.transition(hs2, hs1, serviceTag);
+}
+
+TEST(HMMTest, TrigramPredictIsExactWithFullBeam)
+{
+    for (size_t t = 0; t < 20; ++t)
+    {
+        const uint16_t hiddenStates = 2 + std::rand() % 4;
+        const uint32_t emissions = 1 + std::rand() % 10;
+
+        TestHMM hmm;
+        trainRandom(hmm, hiddenStates, emissions, 20 * hiddenStates);
+
+        TestTrigramHMM hmm3;
+        hmm3.resize(hiddenStates);
+        for (size_t i = 0; i < 30u * hiddenStates; ++i)
+        {
+            hmm3.addHiddenStates(std::rand() % hiddenStates, std::rand() % hiddenStates, std::rand() % hiddenStates);
+        }
+        hmm3.normalize(0.1);
+
+        for (size_t s = 0; s < 10; ++s)
+        {
+            std::vector<uint32_t> sentence(1 + std::rand() % 4);
+            for (auto& e: sentence)
+            {
+                e = std::rand() % emissions;
+            }
+
+            // Enumerate all paths
+            float best = -std::numeric_limits<float>::infinity();
+            std::vector<uint16_t> path(sentence.size(), 0);
+            while (true)
+            {
+                best = std::max(best, trigramPathScore(hmm, hmm3, 0, sentence, path));
+
+                size_t i = 0;
+                while (i < path.size() && ++path[i] == hiddenStates)
+                {
+                    path[i++] = 0;
+                }
+                if (i == path.size())
+                {
+                    break;
+                }
+            }
+
+            const auto res = hmm3.predict(hmm, 0, sentence, hiddenStates * hiddenStates);
+            ASSERT_EQ(res.size(), sentence.size());
+            EXPECT_FLOAT_EQ(trigramPathScore(hmm, hmm3, 0, sentence, res), best);
+
+            EXPECT_EQ(hmm3.predict(hmm, 0, sentence, 2).size(), sentence.size());
+        }
+    }
+}
+
+TEST(HMMTest, TrigramSaveLoad)
+{
+    constexpr const char* fileName = "./trigram.bin.gz";
+
+    TestTrigramHMM hmm1;
+    hmm1.resize(20);
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        hmm1.addHiddenStates(std::rand() % 20, std::rand() % 20, std::rand() % 20);
+    }
+    hmm1.normalize(0.5);
+
+    {
+        ZLibFile zfile(fileName, true);
+        hmm1.saveBinary(zfile);
+    }
+
+    TestTrigramHMM hmm2;
+    {
+        ZLibFile zfile(fileName, false);
+        EXPECT_TRUE(hmm2.loadBinary(zfile));
+    }
+
+    EXPECT_EQ(hmm1, hmm2);
+
+    std::remove(fileName);
+}
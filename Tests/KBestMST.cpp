@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <tuple>
+
+#include "../Math/KBestMST.h"
+#include "../Math/TarjanMST.h"
+#include "../Math/Graph.h"
+
+typedef Graph<float, size_t> G;
+
+static bool isTree(const G::Edges& edges, size_t vertices, size_t root)
+{
+    std::vector<size_t> heads(vertices, size_t(-1));
+    for (const auto& e: edges)
+    {
+        if (e.dest == root || heads[e.dest] != size_t(-1))
+        {
+            return false;
+        }
+        heads[e.dest] = e.src;
+    }
+
+    for (size_t v = 0; v < vertices; ++v)
+    {
+        size_t u = v;
+        for (size_t steps = 0; u != root && u != size_t(-1) && steps < vertices; ++steps)
+        {
+            u = heads[u];
+        }
+        if (u != root)
+        {
+            return false;
+        }
+    }
+    return edges.size() == vertices - 1;
+}
+
+// Weights of all trees, heaviest first
+static std::vector<float> bruteForceWeights(const G& g, size_t root)
+{
+    const size_t vertices = g.numVertices();
+    std::vector<float> res;
+    G::Edges edges;
+
+    std::function<void(size_t)> assign = [&](size_t dest)
+    {
+        if (dest == vertices)
+        {
+            if (isTree(edges, vertices, root))
+            {
+                float w = 0;
+                for (const auto& e: edges)
+                {
+                    w += e.weight;
+                }
+                res.push_back(w);
+            }
+            return;
+        }
+        if (dest == root)
+        {
+            assign(dest + 1);
+            return;
+        }
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t l = 0; l < g.numLabels(); ++l)
+            {
+                if (src != dest && G::isEdge(g.weight(src, dest, l)))
+                {
+                    edges.push_back(G::Edge {src, dest, l, g.weight(src, dest, l)});
+                    assign(dest + 1);
+                    edges.pop_back();
+                }
+            }
+        }
+    };
+    assign(0);
+
+    std::sort(res.rbegin(), res.rend());
+    return res;
+}
+
+TEST(KBestMSTTest, MatchesBruteForce)
+{
+    constexpr size_t labels = 2;
+    constexpr size_t k = 12;
+
+    for (size_t t = 0; t < 100; ++t)
+    {
+        const size_t vertices = 2 + t % 4;
+        const size_t root = t % vertices;
+
+        G g(vertices, labels);
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t dest = 0; dest < vertices; ++dest)
+            {
+                for (size_t l = 0; l < labels; ++l)
+                {
+                    if (rand() % 3 != 0)
+                    {
+                        g.addEdge(src, dest, l, float(rand() % 41) - 20);
+                    }
+                }
+            }
+        }
+
+        const auto expected = bruteForceWeights(g, root);
+
+        KBestMST<G> kBest(g);
+        const auto trees = kBest.getSpanningTrees(root, k);
+
+        ASSERT_EQ(trees.size(), std::min(k, expected.size()));
+
+        std::set<std::vector<std::tuple<size_t, size_t, size_t>>> distinct;
+        for (size_t i = 0; i < trees.size(); ++i)
+        {
+            EXPECT_TRUE(isTree(trees[i].edges, vertices, root));
+            EXPECT_EQ(trees[i].score, expected[i]);
+
+            std::vector<std::tuple<size_t, size_t, size_t>> arcs;
+            for (const auto& e: trees[i].edges)
+            {
+                EXPECT_EQ(e.weight, g.weight(e.src, e.dest, e.label));
+                arcs.emplace_back(e.src, e.dest, e.label);
+            }
+            distinct.insert(arcs);
+        }
+        EXPECT_EQ(distinct.size(), trees.size());
+    }
+}
+
+TEST(KBestMSTTest, FirstIsTarjan)
+{
+    constexpr size_t vertices = 40;
+    constexpr size_t labels = 3;
+
+    G g(vertices, labels);
+    for (size_t src = 0; src < vertices; ++src)
+    {
+        for (size_t dest = 1; dest < vertices; ++dest)
+        {
+            for (size_t l = 0; l < labels; ++l)
+            {
+                g.addEdge(src, dest, l, float(rand() % 1000));
+            }
+        }
+    }
+
+    TarjanMST<G> tarjan(g);
+    const auto best = tarjan.getSpanningTree(0);
+    ASSERT_TRUE(best);
+
+    KBestMST<G> kBest(g);
+    const auto trees = kBest.getSpanningTrees(0, 20);
+
+    ASSERT_EQ(trees.size(), 20);
+    ASSERT_EQ(trees[0].edges.size(), best->size());
+    for (size_t i = 0; i < best->size(); ++i)
+    {
+        EXPECT_EQ(trees[0].edges[i].src, (*best)[i].src);
+        EXPECT_EQ(trees[0].edges[i].label, (*best)[i].label);
+    }
+
+    for (size_t i = 1; i < trees.size(); ++i)
+    {
+        EXPECT_LE(trees[i].score, trees[i - 1].score);
+        EXPECT_TRUE(isTree(trees[i].edges, vertices, 0));
+    }
+
+    EXPECT_TRUE(kBest.getSpanningTrees(0, 0).empty());
+}
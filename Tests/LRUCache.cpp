@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../Math/LRUCache.h"
+
+TEST(LRUCacheTest, EvictsLeastRecentlyUsed)
+{
+    LRUCache<std::string, int> cache(2);
+
+    cache.put("a", 1);
+    cache.put("b", 2);
+
+    EXPECT_EQ(cache.get("a"), 1);
+
+    cache.put("c", 3);
+
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_FALSE(cache.get("b"));
+    EXPECT_EQ(cache.get("a"), 1);
+    EXPECT_EQ(cache.get("c"), 3);
+
+    cache.put("a", 4);
+    cache.put("d", 5);
+
+    EXPECT_EQ(cache.get("a"), 4);
+    EXPECT_FALSE(cache.get("c"));
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_FALSE(cache.get("a"));
+}
+
+TEST(LRUCacheTest, ZeroCapacity)
+{
+    LRUCache<int, int> cache(0);
+
+    cache.put(1, 1);
+
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_FALSE(cache.get(1));
+}
@@ -1,9 +1,99 @@
 #include <gtest/gtest.h>
 
 #include <fstream>
+#include <functional>
+#include <random>
 
 #include "../Math/MSTD.h"
+#include "../Math/TarjanMST.h"
 #include "../Math/Graph.h"
+#include "../Math/SparseGraph.h"
+
+typedef Graph<float, size_t> G;
+
+// Every vertex but root has one head and reaches root
+static bool isTree(const G::Edges& edges, size_t vertices, size_t root)
+{
+    if (edges.size() != vertices - 1)
+    {
+        return false;
+    }
+
+    std::vector<size_t> heads(vertices, size_t(-1));
+    for (const auto& e: edges)
+    {
+        if (e.dest == root || e.dest >= vertices || heads[e.dest] != size_t(-1))
+        {
+            return false;
+        }
+        heads[e.dest] = e.src;
+    }
+
+    for (size_t v = 0; v < vertices; ++v)
+    {
+        size_t u = v;
+        for (size_t steps = 0; u != root && steps < vertices; ++steps)
+        {
+            u = heads[u];
+        }
+        if (u != root)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static float treeWeight(const G& g, const G::Edges& edges)
+{
+    float res = 0;
+    for (const auto& e: edges)
+    {
+        res += g.weight(e.src, e.dest, e.label);
+    }
+    return res;
+}
+
+// Best tree over all head assignments, for small graphs
+static std::optional<float> bruteForceWeight(const G& g, size_t root)
+{
+    const size_t vertices = g.numVertices();
+    std::optional<float> best;
+    G::Edges edges;
+
+    std::function<void(size_t)> assign = [&](size_t dest)
+    {
+        if (dest == vertices)
+        {
+            if (isTree(edges, vertices, root))
+            {
+                const float w = treeWeight(g, edges);
+                best = best ? std::max(*best, w) : w;
+            }
+            return;
+        }
+        if (dest == root)
+        {
+            assign(dest + 1);
+            return;
+        }
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t l = 0; l < g.numLabels(); ++l)
+            {
+                if (src != dest && G::isEdge(g.weight(src, dest, l)))
+                {
+                    edges.push_back(G::Edge {src, dest, l, 0});
+                    assign(dest + 1);
+                    edges.pop_back();
+                }
+            }
+        }
+    };
+    assign(0);
+
+    return best;
+}
 
 TEST(MSTDTest, SpanningTree1Cycle)
 {
@@ -92,3 +182,202 @@ TEST(MSTDTest, SpanningTreeRandom)
         }
     }
 }
+
+TEST(MSTDTest, TarjanSpanningTree1Cycle)
+{
+    constexpr size_t vertices = 6;
+    constexpr size_t root = 0;
+
+    G g(vertices, 1);
+
+    g.addEdge(root, 1, 0, 1.0f);
+    g.addEdge(2, 1, 0, 3.0f);
+    g.addEdge(3, 1, 0, 2.0f);
+
+    g.addEdge(root, 2, 0, 1.0f);
+    g.addEdge(1, 2, 0, 3.0f);
+    g.addEdge(3, 2, 0, 2.0f);
+
+    g.addEdge(root, 3, 0, 3.0f);
+    g.addEdge(1, 3, 0, 2.0f);
+    g.addEdge(2, 3, 0, 2.0f);
+
+    g.addEdge(1, 5, 0, 2.0f);
+
+    g.addEdge(root, 4, 0, 12.0f);
+
+    TarjanMST<G> mst(g);
+
+    auto res = mst.getSpanningTree(root);
+
+    ASSERT_TRUE(res);
+    EXPECT_TRUE(isTree(*res, vertices, root));
+    EXPECT_EQ(treeWeight(g, *res), 22.0f);
+    EXPECT_EQ(g.edges().size(), 11);
+
+    // Vertex 5 can only hang on 1, without it there is no tree
+    g.removeEdge(1, 5, 0);
+    EXPECT_FALSE(mst.getSpanningTree(root));
+}
+
+TEST(MSTDTest, TarjanMatchesBruteForce)
+{
+    constexpr size_t vertices = 5;
+    constexpr size_t labels = 3;
+
+    for (size_t t = 0; t < 200; ++t)
+    {
+        const size_t root = t % vertices;
+
+        G g(vertices, labels);
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t dest = 0; dest < vertices; ++dest)
+            {
+                for (size_t l = 0; l < labels; ++l)
+                {
+                    if (rand() % 3 != 0)
+                    {
+                        g.addEdge(src, dest, l, float(rand() % 41) - 20);
+                    }
+                }
+            }
+        }
+
+        const auto expected = bruteForceWeight(g, root);
+
+        TarjanMST<G> mst(g);
+        const auto res = mst.getSpanningTree(root);
+
+        ASSERT_EQ(bool(res), bool(expected));
+        if (res)
+        {
+            EXPECT_TRUE(isTree(*res, vertices, root));
+            EXPECT_EQ(treeWeight(g, *res), *expected);
+            for (const auto& e: *res)
+            {
+                EXPECT_EQ(e.weight, g.weight(e.src, e.dest, e.label));
+            }
+        }
+    }
+}
+
+// The original solver changes the graph, so it gets a copy of the edges. It may return a non-tree,
+// and even its trees are not always maximal (about a third of them are lighter at 81 vertices),
+// so Tarjan's tree is checked to be at least as heavy, not equal.
+TEST(MSTDTest, TarjanCrossCheck)
+{
+    constexpr size_t root = 0;
+    constexpr size_t labels = 4;
+    constexpr size_t trials = 100;
+
+    std::mt19937 gen(16);
+
+    for (size_t vertices: {6, 20, 81})
+    {
+        size_t compared = 0;
+        for (size_t t = 0; t < trials; ++t)
+        {
+            G g(vertices, labels);
+            for (size_t src = 0; src < vertices; ++src)
+            {
+                for (size_t dest = 0; dest < vertices; ++dest)
+                {
+                    for (size_t l = 0; l < labels; ++l)
+                    {
+                        g.addEdge(src, dest, l, 1 + gen() % (labels * vertices));
+                    }
+                }
+            }
+
+            TarjanMST<G> tarjan(g);
+            const auto res = tarjan.getSpanningTree(root);
+            ASSERT_TRUE(res);
+            ASSERT_TRUE(isTree(*res, vertices, root));
+            for (const auto& e: *res)
+            {
+                EXPECT_EQ(e.weight, g.weight(e.src, e.dest, e.label));
+            }
+
+            G copy(vertices, labels, g.edges());
+            ChuLiuEdmondsMST<G> chuLiuEdmonds(copy);
+            const auto original = chuLiuEdmonds.getSpanningTree(root);
+
+            // Original weights are reduced by the solver, so they are taken from the graph
+            if (original && isTree(*original, vertices, root))
+            {
+                EXPECT_GE(treeWeight(g, *res), treeWeight(g, *original));
+                ++compared;
+            }
+        }
+
+        // The original solver gives a tree in about a fifth of the cases at 81 vertices and more often below
+        EXPECT_GE(compared, trials / 10) << vertices << " vertices";
+    }
+}
+
+// Solvers see the same edges in the same order through forEachIncoming, so the trees are the same
+TEST(MSTDTest, SparseMatchesDense)
+{
+    typedef SparseGraph<float, size_t> S;
+
+    constexpr size_t labels = 3;
+
+    for (size_t t = 0; t < 40; ++t)
+    {
+        const size_t vertices = 2 + t % 25;
+        const size_t root = t % vertices;
+
+        G::Edges edges;
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t dest = 0; dest < vertices; ++dest)
+            {
+                for (size_t l = 0; l < labels; ++l)
+                {
+                    // Pruned graph with a path from root to keep it spanning
+                    if (rand() % 4 == 0 || (src == (dest + vertices - 1) % vertices && dest != root))
+                    {
+                        edges.push_back(G::Edge {src, dest, l, float(1 + rand() % 50)});
+                    }
+                }
+            }
+        }
+
+        G dense(vertices, labels, edges);
+        S sparse(vertices, labels, edges);
+
+        TarjanMST<G> denseTarjan(dense);
+        TarjanMST<S> sparseTarjan(sparse);
+        const auto expected = denseTarjan.getSpanningTree(root);
+        const auto res = sparseTarjan.getSpanningTree(root);
+
+        ASSERT_TRUE(expected);
+        ASSERT_TRUE(res);
+        ASSERT_TRUE(isTree(*res, vertices, root));
+        EXPECT_EQ(treeWeight(dense, *res), treeWeight(dense, *expected));
+        for (size_t i = 0; i < res->size(); ++i)
+        {
+            EXPECT_EQ((*res)[i].src, (*expected)[i].src);
+            EXPECT_EQ((*res)[i].label, (*expected)[i].label);
+        }
+
+        ChuLiuEdmondsMST<G> denseChuLiuEdmonds(dense);
+        ChuLiuEdmondsMST<S> sparseChuLiuEdmonds(sparse);
+        const auto expectedOriginal = denseChuLiuEdmonds.getSpanningTree(root);
+        const auto original = sparseChuLiuEdmonds.getSpanningTree(root);
+
+        ASSERT_EQ(bool(expectedOriginal), bool(original));
+        if (original)
+        {
+            ASSERT_EQ(original->size(), expectedOriginal->size());
+            for (size_t i = 0; i < original->size(); ++i)
+            {
+                EXPECT_EQ((*original)[i].src, (*expectedOriginal)[i].src);
+                EXPECT_EQ((*original)[i].dest, (*expectedOriginal)[i].dest);
+                EXPECT_EQ((*original)[i].label, (*expectedOriginal)[i].label);
+            }
+            EXPECT_EQ(sparse.numEdges(), dense.edges().size());
+        }
+    }
+}
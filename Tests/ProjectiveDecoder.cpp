@@ -0,0 +1,270 @@
+#include <gtest/gtest.h>
+
+#include <functional>
+
+#include "../Math/ProjectiveDecoder.h"
+#include "../Math/TarjanMST.h"
+#include "../Math/Graph.h"
+#include "../Math/SparseGraph.h"
+
+typedef Graph<float, size_t> G;
+
+// Tree rooted at 0 without crossing arcs
+static bool isProjectiveTree(const G::Edges& edges, size_t vertices)
+{
+    if (edges.size() != vertices - 1)
+    {
+        return false;
+    }
+
+    std::vector<size_t> heads(vertices, size_t(-1));
+    for (const auto& e: edges)
+    {
+        if (e.dest == 0 || e.dest >= vertices || heads[e.dest] != size_t(-1))
+        {
+            return false;
+        }
+        heads[e.dest] = e.src;
+    }
+
+    auto dominates = [&](size_t h, size_t v)
+    {
+        for (size_t steps = 0; steps <= vertices && v != size_t(-1); ++steps)
+        {
+            if (v == h)
+            {
+                return true;
+            }
+            v = heads[v];
+        }
+        return false;
+    };
+
+    for (size_t v = 1; v < vertices; ++v)
+    {
+        if (!dominates(0, v))
+        {
+            return false;
+        }
+    }
+
+    for (const auto& e: edges)
+    {
+        for (size_t v = std::min(e.src, e.dest) + 1; v < std::max(e.src, e.dest); ++v)
+        {
+            if (!dominates(e.src, v))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static float treeWeight(const G& g, const G::Edges& edges)
+{
+    float res = 0;
+    for (const auto& e: edges)
+    {
+        res += g.weight(e.src, e.dest, e.label);
+    }
+    return res;
+}
+
+static std::optional<float> bruteForceWeight(const G& g)
+{
+    const size_t vertices = g.numVertices();
+    std::optional<float> best;
+    G::Edges edges;
+
+    std::function<void(size_t)> assign = [&](size_t dest)
+    {
+        if (dest == vertices)
+        {
+            if (isProjectiveTree(edges, vertices))
+            {
+                const float w = treeWeight(g, edges);
+                best = best ? std::max(*best, w) : w;
+            }
+            return;
+        }
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t l = 0; l < g.numLabels(); ++l)
+            {
+                if (src != dest && G::isEdge(g.weight(src, dest, l)))
+                {
+                    edges.push_back(G::Edge {src, dest, l, 0});
+                    assign(dest + 1);
+                    edges.pop_back();
+                }
+            }
+        }
+    };
+    assign(1);
+
+    return best;
+}
+
+TEST(ProjectiveDecoderTest, Chain)
+{
+    constexpr size_t vertices = 5;
+
+    G g(vertices, 2);
+    for (size_t src = 0; src < vertices; ++src)
+    {
+        for (size_t dest = 1; dest < vertices; ++dest)
+        {
+            if (src != dest)
+            {
+                g.addEdge(src, dest, 0, 0.0f);
+            }
+        }
+    }
+
+    for (size_t v = 1; v < vertices; ++v)
+    {
+        g.addEdge(v - 1, v, 1, 1.0f);
+    }
+
+    ProjectiveDecoder<G> decoder(g);
+
+    const auto res = decoder.getSpanningTree(0);
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->size(), vertices - 1);
+
+    for (size_t v = 1; v < vertices; ++v)
+    {
+        const auto& e = (*res)[v - 1];
+        EXPECT_EQ(e.src, v - 1);
+        EXPECT_EQ(e.dest, v);
+        EXPECT_EQ(e.label, 1);
+        EXPECT_EQ(e.weight, 1.0f);
+    }
+
+    EXPECT_FALSE(decoder.getSpanningTree(1));
+}
+
+TEST(ProjectiveDecoderTest, MatchesBruteForce)
+{
+    for (size_t t = 0; t < 300; ++t)
+    {
+        const size_t vertices = 1 + t % 6;
+        constexpr size_t labels = 3;
+
+        G g(vertices, labels);
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t dest = 0; dest < vertices; ++dest)
+            {
+                for (size_t l = 0; l < labels; ++l)
+                {
+                    if (rand() % 4 != 0)
+                    {
+                        g.addEdge(src, dest, l, float(rand() % 41) - 20);
+                    }
+                }
+            }
+        }
+
+        const auto expected = bruteForceWeight(g);
+
+        ProjectiveDecoder<G> decoder(g);
+        const auto res = decoder.getSpanningTree(0);
+
+        ASSERT_EQ(bool(res), bool(expected));
+        if (res)
+        {
+            EXPECT_TRUE(isProjectiveTree(*res, vertices));
+            EXPECT_EQ(treeWeight(g, *res), *expected);
+        }
+    }
+}
+
+// Projective trees are a subset of all trees, so they can not be heavier
+TEST(ProjectiveDecoderTest, CrossCheckTarjan)
+{
+    size_t projective = 0;
+    for (size_t t = 0; t < 50; ++t)
+    {
+        const size_t vertices = 2 + t % 30;
+
+        G g(vertices, 2);
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t dest = 1; dest < vertices; ++dest)
+            {
+                for (size_t l = 0; l < 2; ++l)
+                {
+                    if (src != dest)
+                    {
+                        const float distance = std::fabs(float(src) - float(dest));
+                        g.addEdge(src, dest, l, float(rand() % 64) - 16 * distance);
+                    }
+                }
+            }
+        }
+
+        ProjectiveDecoder<G> decoder(g);
+        const auto res = decoder.getSpanningTree(0);
+
+        TarjanMST<G> tarjan(g);
+        const auto best = tarjan.getSpanningTree(0);
+
+        ASSERT_TRUE(res);
+        ASSERT_TRUE(best);
+        EXPECT_TRUE(isProjectiveTree(*res, vertices));
+        EXPECT_LE(treeWeight(g, *res), treeWeight(g, *best));
+
+        if (isProjectiveTree(*best, vertices))
+        {
+            EXPECT_EQ(treeWeight(g, *res), treeWeight(g, *best));
+            ++projective;
+        }
+    }
+
+    EXPECT_GT(projective, 0);
+}
+
+TEST(ProjectiveDecoderTest, SparseMatchesDense)
+{
+    typedef SparseGraph<float, size_t> S;
+
+    for (size_t t = 0; t < 50; ++t)
+    {
+        const size_t vertices = 1 + t % 20;
+
+        G::Edges edges;
+        for (size_t src = 0; src < vertices; ++src)
+        {
+            for (size_t dest = 1; dest < vertices; ++dest)
+            {
+                for (size_t l = 0; l < 2; ++l)
+                {
+                    if (src != dest && (rand() % 3 == 0 || src + 1 == dest))
+                    {
+                        edges.push_back(G::Edge {src, dest, l, float(rand() % 41) - 20});
+                    }
+                }
+            }
+        }
+
+        G dense(vertices, 2, edges);
+        S sparse(vertices, 2, edges);
+
+        ProjectiveDecoder<G> denseDecoder(dense);
+        ProjectiveDecoder<S> sparseDecoder(sparse);
+        const auto expected = denseDecoder.getSpanningTree(0);
+        const auto res = sparseDecoder.getSpanningTree(0);
+
+        ASSERT_TRUE(expected);
+        ASSERT_TRUE(res);
+        ASSERT_EQ(res->size(), expected->size());
+        for (size_t i = 0; i < res->size(); ++i)
+        {
+            EXPECT_EQ((*res)[i].src, (*expected)[i].src);
+            EXPECT_EQ((*res)[i].label, (*expected)[i].label);
+            EXPECT_EQ((*res)[i].weight, (*expected)[i].weight);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "../Math/Quantized.h"
+
+TEST(QuantizedTest, HalfConversion)
+{
+    for (const float value: {0.0f, -0.0f, 1.0f, -2.5f, 0.333251953125f, 65504.0f, -13.8125f})
+    {
+        EXPECT_EQ(halfToFloat(floatToHalf(value)), value);
+    }
+
+    EXPECT_EQ(halfToFloat(floatToHalf(1e6f)), std::numeric_limits<float>::infinity());
+    EXPECT_EQ(halfToFloat(floatToHalf(-std::numeric_limits<float>::infinity())), -std::numeric_limits<float>::infinity());
+    EXPECT_TRUE(std::isnan(halfToFloat(floatToHalf(std::numeric_limits<float>::quiet_NaN()))));
+
+    // Smallest subnormal half and rounding to nearest even
+    EXPECT_EQ(halfToFloat(0x0001), std::ldexp(1.0f, -24));
+    EXPECT_EQ(floatToHalf(std::ldexp(1.0f, -24)), 0x0001);
+    EXPECT_EQ(floatToHalf(1.0f + std::ldexp(1.0f, -11)), 0x3C00);
+    EXPECT_EQ(floatToHalf(1.0f + 3 * std::ldexp(1.0f, -11)), 0x3C02);
+
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        const float value = -30.0f * std::rand() / RAND_MAX;
+        EXPECT_NEAR(halfToFloat(floatToHalf(value)), value, std::abs(value) / 1024);
+    }
+}
+
+TEST(QuantizedTest, DecodeMatchesAt)
+{
+    const std::vector<uint32_t> offsets = {0, 3, 3, 40, 41};
+    std::vector<float> values(offsets.back());
+    for (auto& v: values)
+    {
+        v = -20.0f * std::rand() / RAND_MAX;
+    }
+    values[5] = -std::numeric_limits<float>::infinity();
+
+    for (const Storage storage: {Storage::Float16, Storage::Int8})
+    {
+        QuantizedRows<float> rows;
+        rows.encode(storage, values.data(), offsets);
+
+        EXPECT_EQ(rows.getStorage(), storage);
+        EXPECT_EQ(rows.rows(), offsets.size() - 1);
+        EXPECT_LT(rows.bytes(), values.size() * sizeof(float));
+
+        for (size_t r = 0; r < rows.rows(); ++r)
+        {
+            std::vector<float> decoded(offsets[r + 1] - offsets[r]);
+            rows.decode(r, decoded.data());
+
+            // Int8 error is at most half of the step of the row
+            for (size_t i = 0; i < decoded.size(); ++i)
+            {
+                const float value = values[offsets[r] + i];
+                EXPECT_EQ(decoded[i], rows.at(r, i));
+                if (std::isinf(value))
+                {
+                    EXPECT_EQ(decoded[i], value);
+                }
+                else
+                {
+                    EXPECT_NEAR(decoded[i], value, storage == Storage::Int8 ? 20.0f / 254 : 0.02f);
+                }
+            }
+        }
+    }
+}
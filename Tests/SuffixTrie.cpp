@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "../ML/SuffixTrie.h"
+
+typedef SuffixTrie<float, uint16_t> TestSuffixTrie;
+
+static void fill(TestSuffixTrie& trie)
+{
+    trie.add("walking", 1);
+    trie.add("talking", 1);
+    trie.add("walked", 2);
+    trie.add("talked", 2);
+    trie.add("quickly", 3);
+    trie.add("бегать", 4);
+    trie.add("читать", 4);
+    trie.finalize();
+}
+
+TEST(SuffixTrieTest, Estimate)
+{
+    TestSuffixTrie trie;
+
+    EXPECT_TRUE(trie.estimate("anything").states.empty());
+
+    fill(trie);
+
+    const auto ing = trie.estimate("jumping");
+    EXPECT_EQ(ing.states, std::vector<uint16_t>({1}));
+    EXPECT_GT(ing.scores[0], 0);
+
+    const auto ed = trie.estimate("jumped");
+    EXPECT_EQ(ed.states, std::vector<uint16_t>({2}));
+
+    // Cyrillic suffix is matched by code points
+    EXPECT_EQ(trie.estimate("играть").states, std::vector<uint16_t>({4}));
+
+    // Nothing matches, so every state is a candidate with the same score
+    const auto none = trie.estimate("xyz");
+    EXPECT_EQ(none.states, std::vector<uint16_t>({1, 2, 3, 4}));
+    for (const auto score: none.scores)
+    {
+        EXPECT_FLOAT_EQ(score, 0);
+    }
+
+    // Cached estimate is the same
+    const auto again = trie.estimate("jumping");
+    EXPECT_EQ(again.states, ing.states);
+    EXPECT_EQ(again.scores, ing.scores);
+}
+
+TEST(SuffixTrieTest, SaveLoad)
+{
+    constexpr const char* fileName = "./suffixes.bin.gz";
+
+    TestSuffixTrie trie1;
+    fill(trie1);
+
+    {
+        ZLibFile zfile(fileName, true);
+        trie1.saveBinary(zfile);
+    }
+
+    TestSuffixTrie trie2;
+    {
+        ZLibFile zfile(fileName, false);
+        EXPECT_TRUE(trie2.loadBinary(zfile));
+    }
+
+    EXPECT_EQ(trie1, trie2);
+    EXPECT_EQ(trie1.estimate("jumped").scores, trie2.estimate("jumped").scores);
+
+    std::remove(fileName);
+}
@@ -133,10 +133,215 @@ TEST(SupportCInterfaceTest, TrainTagger)
 
     EXPECT_TRUE(loadTagger(nativeFileName));
 
+    constexpr size_t len = 4;
+    size_t words[len] = {0};
+    const char* forms[len] = {"drop", "the", "mic", "."};
+    for (size_t i = 0; i < len; ++i)
+    {
+        EXPECT_TRUE(word2index(const_cast<char*>(forms[i]), &words[i]));
+    }
+
+    size_t result[len] = {0};
+    EXPECT_TRUE(tag(words, len, result));
+
+    // Quantized tagger keeps its storage through save and load, but can not be extended
+    for (size_t storage: {1, 2})
+    {
+        EXPECT_TRUE(trainTagger(0.5));
+        EXPECT_FALSE(quantizeTagger(3));
+        EXPECT_TRUE(quantizeTagger(storage));
+        EXPECT_FALSE(quantizeTagger(storage));
+        EXPECT_FALSE(addSentences(fileName, "CoNLLU"));
+
+        EXPECT_TRUE(saveTagger(nativeFileName));
+        EXPECT_TRUE(loadTagger(nativeFileName));
+
+        size_t resultQuantized[len] = {0};
+        EXPECT_TRUE(tag(words, len, resultQuantized));
+        EXPECT_TRUE(std::equal(result, result + len, resultQuantized));
+    }
+
+    EXPECT_TRUE(trainTagger(0.5));
+
+    std::remove(fileName);
+    std::remove(nativeFileName);
+}
+
+TEST(SupportCInterfaceTest, AddSentences)
+{
+    constexpr char* fileName = "./test.conllu";
+    constexpr char* moreFileName = "./test-more.conllu";
+    constexpr char* nativeFileName = "./test.bin.gz";
+
+    {
+        std::ofstream test(fileName);
+        test << TestCoNLLU;
+    }
+
+    {
+        std::ofstream test(moreFileName);
+        test << "# sent_id = 1\n"
+             << "1\tDrop\tdrop\tVERB\tVB\tVerbForm=Inf\t0\troot\t0:root\t_\n"
+             << "2\tit\tit\tPRON\tPRP\tCase=Acc|Number=Sing\t1\tobj\t1:obj\t_\n"
+             << "\n";
+    }
+
+    EXPECT_TRUE(parse(fileName, "CoNLLU"));
+    EXPECT_TRUE(trainTagger(0.5));
+    EXPECT_TRUE(saveTagger(nativeFileName));
+    EXPECT_TRUE(loadTagger(nativeFileName));
+
+    EXPECT_FALSE(addSentences(moreFileName, "Unknown"));
+    EXPECT_TRUE(addSentences(moreFileName, "CoNLLU"));
+
+    size_t words[2] = {0};
+    EXPECT_TRUE(word2index("drop", &words[0]));
+    EXPECT_TRUE(word2index("it", &words[1]));
+
+    size_t result[2] = {0};
+    EXPECT_TRUE(tag(words, 2, result));
+
+    EXPECT_TRUE(trainTaggerWithOrder(0.5, 3));
+    EXPECT_TRUE(addSentences(moreFileName, "CoNLLU"));
+    EXPECT_TRUE(tag(words, 2, result));
+
     std::remove(fileName);
+    std::remove(moreFileName);
     std::remove(nativeFileName);
 }
 
+TEST(SupportCInterfaceTest, Tag)
+{
+    constexpr char* fileName = "./test.conllu";
+
+    {
+        std::ofstream test(fileName);
+        test << TestCoNLLU;
+        test.close();
+    }
+
+    EXPECT_TRUE(parse(fileName, "CoNLLU"));
+
+    EXPECT_TRUE(trainTagger(0.5));
+
+    constexpr size_t len = 4;
+    size_t words[len] = {0};
+    const char* forms[len] = {"drop", "the", "mic", "."};
+    for (size_t i = 0; i < len; ++i)
+    {
+        EXPECT_TRUE(word2index(const_cast<char*>(forms[i]), &words[i]));
+    }
+
+    size_t result[len] = {0};
+    size_t resultWithLexicon[len] = {0};
+
+    EXPECT_TRUE(tag(words, len, result));
+    EXPECT_TRUE(tagWithLexicon(words, len, resultWithLexicon));
+
+    size_t resultBeam[len] = {0};
+
+    EXPECT_TRUE(tagBeam(words, len, 1024, false, resultBeam));
+    EXPECT_TRUE(std::equal(result, result + len, resultBeam));
+    EXPECT_TRUE(tagBeam(words, len, 2, true, resultBeam));
+    EXPECT_FALSE(tagBeam(words, len, 0, false, resultBeam));
+
+    constexpr size_t sentences = 3;
+    size_t batch[sentences * len] = {0};
+    size_t offsets[sentences + 1] = {0, len, len, 3 * len - 1};
+    std::copy(words, words + len, batch);
+    std::copy(words, words + len, batch + len);
+    std::copy(words, words + len - 1, batch + 2 * len);
+
+    size_t resultBatch[sentences * len] = {0};
+    EXPECT_TRUE(tagBatch(batch, offsets, sentences, 0, false, resultBatch));
+    EXPECT_TRUE(std::equal(result, result + len, resultBatch));
+    EXPECT_TRUE(std::equal(result, result + len, resultBatch + len));
+
+    size_t resultShort[len - 1] = {0};
+    EXPECT_TRUE(tag(words, len - 1, resultShort));
+    EXPECT_TRUE(std::equal(resultShort, resultShort + len - 1, resultBatch + 2 * len));
+
+    constexpr size_t sequences = 3;
+    size_t nbestTags[sequences * len] = {0};
+    float nbestScores[sequences] = {0};
+    size_t found = 0;
+    EXPECT_TRUE(tagNBest(words, len, sequences, false, nbestTags, nbestScores, &found));
+    EXPECT_GE(found, 1u);
+    EXPECT_LE(found, sequences);
+    EXPECT_TRUE(std::equal(result, result + len, nbestTags));
+    EXPECT_TRUE(std::is_sorted(nbestScores, nbestScores + found, std::greater<float>()));
+    EXPECT_FALSE(tagNBest(words, len, 0, false, nbestTags, nbestScores, &found));
+
+    // Streamed words give the same tags as the whole sentence
+    std::vector<size_t> streamed(tagStreamLatency());
+    size_t total = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        size_t decided = 0;
+        EXPECT_TRUE(pushWord(words[i], false, streamed.data() + total, &decided));
+        total += decided;
+    }
+    size_t decided = 0;
+    EXPECT_TRUE(flushWords(streamed.data() + total, &decided));
+    total += decided;
+    EXPECT_EQ(total, len);
+    EXPECT_TRUE(std::equal(result, result + len, streamed.begin()));
+
+    // Forms are lowercased, unknown "tic" gets the tag of "mic" by its suffix
+    char* mixedForms[len] = {"Drop", "THE", "tic", "."};
+    size_t resultForms[len] = {0};
+    EXPECT_TRUE(tagForms(mixedForms, len, 0, false, resultForms));
+    EXPECT_TRUE(std::equal(result, result + len, resultForms));
+
+    constexpr size_t k = 2;
+    size_t posteriorTags[len * k] = {0};
+    float probabilities[len * k] = {0};
+    EXPECT_FALSE(tagPosteriors(words, len, 0, false, posteriorTags, probabilities));
+    EXPECT_TRUE(tagPosteriors(words, len, k, true, posteriorTags, probabilities));
+    for (size_t i = 0; i < len; ++i)
+    {
+        EXPECT_GE(probabilities[i * k], probabilities[i * k + 1]);
+        EXPECT_LE(probabilities[i * k] + probabilities[i * k + 1], 1.0001);
+    }
+
+    constexpr char* nativeFileName = "./test.bin.gz";
+
+    EXPECT_FALSE(trainTaggerWithOrder(0.5, 4));
+    EXPECT_TRUE(trainTaggerWithOrder(0.5, 3));
+
+    size_t resultTrigram[len] = {0};
+    EXPECT_TRUE(tag(words, len, resultTrigram));
+    EXPECT_TRUE(tagWithLexicon(words, len, resultWithLexicon));
+
+    EXPECT_TRUE(saveTagger(nativeFileName));
+    EXPECT_TRUE(loadTagger(nativeFileName));
+
+    size_t resultLoaded[len] = {0};
+    EXPECT_TRUE(tag(words, len, resultLoaded));
+    EXPECT_TRUE(std::equal(resultTrigram, resultTrigram + len, resultLoaded));
+
+    // Truncated file is rejected and the loaded tagger is kept
+    constexpr char* truncatedFileName = "./test-truncated.bin.gz";
+    {
+        std::ifstream in(nativeFileName, std::ios::binary);
+        const std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::ofstream out(truncatedFileName, std::ios::binary);
+        out.write(content.data(), content.size() / 2);
+    }
+
+    EXPECT_FALSE(loadTagger(truncatedFileName));
+
+    size_t resultKept[len] = {0};
+    EXPECT_TRUE(tag(words, len, resultKept));
+    EXPECT_TRUE(std::equal(resultTrigram, resultTrigram + len, resultKept));
+
+    EXPECT_TRUE(trainTagger(0.5));
+
+    std::remove(truncatedFileName);
+    std::remove(nativeFileName);
+
+    std::remove(fileName);
+}
 
 TEST(SupportCInterfaceTest, TrainTreeBuilder)
 {
@@ -157,7 +362,127 @@ TEST(SupportCInterfaceTest, TrainTreeBuilder)
 
     EXPECT_TRUE(loadTreeBuilder(nativeFileName));
 
+    EXPECT_FALSE(setTreeSolver(3));
+    EXPECT_TRUE(setTreeSolver(1));
+
+    constexpr size_t len = 3;
+    size_t tags[len] = {0, 1, 2};
+    size_t edges[3 * len] = {0};
+    EXPECT_TRUE(buildDependencyTree(tags, len, edges));
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        EXPECT_EQ(edges[3 * i + 1], i + 1);
+        EXPECT_LE(edges[3 * i], len);
+        EXPECT_NE(edges[3 * i], i + 1);
+    }
+
+    EXPECT_FALSE(buildDependencyTreeWith(tags, len, 3, edges));
+
+    size_t projectiveEdges[3 * len] = {0};
+    EXPECT_TRUE(buildDependencyTreeWith(tags, len, 2, projectiveEdges));
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        EXPECT_EQ(projectiveEdges[3 * i + 1], i + 1);
+        EXPECT_LE(projectiveEdges[3 * i], len);
+        EXPECT_NE(projectiveEdges[3 * i], i + 1);
+    }
+
+    // Batch of the sentence above, a shorter one and an empty one
+    size_t batchTags[] = {0, 1, 2, 2, 0};
+    size_t offsets[] = {0, 3, 5, 5};
+    size_t batchEdges[3 * 5] = {0};
+    EXPECT_TRUE(buildDependencyTrees(batchTags, offsets, 3, batchEdges));
+    EXPECT_TRUE(std::equal(edges, edges + 3 * len, batchEdges));
+
+    size_t shortEdges[3 * 2] = {0};
+    EXPECT_TRUE(buildDependencyTree(batchTags + 3, 2, shortEdges));
+    EXPECT_TRUE(std::equal(shortEdges, shortEdges + 3 * 2, batchEdges + 3 * len));
+
+    size_t wrongOffsets[] = {0, 4, 3, 5};
+    EXPECT_FALSE(buildDependencyTrees(batchTags, wrongOffsets, 3, batchEdges));
+
+    // The best tree comes first, then alternatives by score
+    constexpr size_t k = 4;
+    size_t nBestEdges[3 * len * k] = {0};
+    float nBestScores[k] = {0};
+    size_t found = 0;
+    EXPECT_TRUE(buildDependencyTreeNBest(tags, len, k, nBestEdges, nBestScores, &found));
+    EXPECT_GT(found, 1);
+    EXPECT_LE(found, k);
+    EXPECT_TRUE(std::equal(edges, edges + 3 * len, nBestEdges));
+    for (size_t p = 1; p < found; ++p)
+    {
+        EXPECT_LE(nBestScores[p], nBestScores[p - 1]);
+        EXPECT_FALSE(std::equal(nBestEdges, nBestEdges + 3 * len, nBestEdges + 3 * len * p));
+    }
+
+    EXPECT_FALSE(buildDependencyTreeNBest(tags, len, 0, nBestEdges, nBestScores, &found));
+
+    std::remove(fileName);
+    std::remove(nativeFileName);
+}
+
+TEST(SupportCInterfaceTest, Analyze)
+{
+    constexpr char* fileName = "./test.conllu";
+
+    {
+        std::ofstream test(fileName);
+        test << TestCoNLLU;
+        test.close();
+    }
+
+    EXPECT_TRUE(parse(fileName, "CoNLLU"));
+    EXPECT_TRUE(trainTagger(0.5));
+    EXPECT_TRUE(trainTreeBuilder(0.5));
+
+    constexpr size_t len = 4;
+    size_t words[len] = {0};
+    const char* forms[len] = {"drop", "the", "mic", "."};
+    for (size_t i = 0; i < len; ++i)
+    {
+        EXPECT_TRUE(word2index(const_cast<char*>(forms[i]), &words[i]));
+    }
+
+    // Same as the two calls one after another
+    size_t tags[len] = {0};
+    size_t edges[3 * len] = {0};
+    EXPECT_TRUE(analyze(words, len, 0, true, tags, edges));
+
+    size_t expectedTags[len] = {0};
+    size_t expectedEdges[3 * len] = {0};
+    EXPECT_TRUE(tagWithLexicon(words, len, expectedTags));
+    EXPECT_TRUE(buildDependencyTree(expectedTags, len, expectedEdges));
+
+    EXPECT_TRUE(std::equal(tags, tags + len, expectedTags));
+    EXPECT_TRUE(std::equal(edges, edges + 3 * len, expectedEdges));
+
+    EXPECT_TRUE(analyze(words, len, 4, false, tags, edges));
+    EXPECT_TRUE(tagBeam(words, len, 4, false, expectedTags));
+    EXPECT_TRUE(std::equal(tags, tags + len, expectedTags));
+
+    EXPECT_FALSE(analyze(words, len, 0, false, nullptr, edges));
+
+    // A tree builder trained before new relations came is not loaded for them
+    constexpr char* nativeFileName = "./test.bin.gz";
+    constexpr char* moreFileName = "./test-more.conllu";
+    {
+        std::ofstream test(moreFileName);
+        test << "# sent_id = 1\n"
+             << "1\tit\tit\tPRON\tPRP\tCase=Acc|Number=Sing\t2\tobj\t2:obj\t_\n"
+             << "2\tdrop\tdrop\tVERB\tVB\tVerbForm=Inf\t0\troot\t0:root\t_\n"
+             << "\n";
+    }
+
+    EXPECT_TRUE(saveTreeBuilder(nativeFileName));
+    EXPECT_TRUE(loadTreeBuilder(nativeFileName));
+    EXPECT_TRUE(parse(moreFileName, "CoNLLU"));
+    EXPECT_FALSE(loadTreeBuilder(nativeFileName));
+
     std::remove(fileName);
+    std::remove(moreFileName);
     std::remove(nativeFileName);
 }
 
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "../Engine/ThreadPool.h"
+
+TEST(ThreadPoolTest, ParallelForCoversRange)
+{
+    for (size_t threads = 1; threads < 6; ++threads)
+    {
+        ThreadPool pool(threads);
+
+        EXPECT_EQ(pool.size(), threads);
+
+        for (size_t t = 0; t < 20; ++t)
+        {
+            const size_t n = std::rand() % 1000;
+            std::vector<std::atomic<size_t>> visited(n);
+
+            pool.parallelFor(n, [&](size_t begin, size_t end, size_t worker)
+            {
+                EXPECT_LT(worker, threads);
+                for (size_t i = begin; i < end; ++i)
+                {
+                    ++visited[i];
+                }
+            });
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                EXPECT_EQ(visited[i], 1);
+            }
+        }
+    }
+}
+
+TEST(ThreadPoolTest, Submit)
+{
+    ThreadPool pool(3);
+
+    std::atomic<size_t> sum = 0;
+
+    pool.parallelFor(100, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            pool.submit([&, i](size_t) { sum += i; });
+        }
+    });
+
+    while (sum != 99 * 100 / 2)
+    {
+        std::this_thread::yield();
+    }
+
+    EXPECT_EQ(sum, 99 * 100 / 2);
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "../Engine/TraceSink.h"
+
+TEST(TraceSinkTest, Sample)
+{
+    const std::string directory = "./trace-sample";
+
+    {
+        TraceSink sink(directory, 3);
+
+        size_t sampled = 0;
+        for (size_t i = 0; i < 10; ++i)
+        {
+            const auto trace = sink.sample();
+            if (trace)
+            {
+                EXPECT_EQ(*trace % 3, 0);
+                ++sampled;
+            }
+        }
+        EXPECT_EQ(sampled, 4);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(TraceSinkTest, Write)
+{
+    const std::string directory = "./trace-write";
+
+    {
+        TraceSink sink(directory);
+
+        for (size_t i = 0; i < 20; ++i)
+        {
+            const auto trace = sink.sample();
+            ASSERT_TRUE(trace);
+            sink.record(*trace, "graph", "digraph {" + std::to_string(i) + "}");
+        }
+
+        sink.flush();
+        EXPECT_EQ(sink.written() + sink.dropped(), 20);
+        EXPECT_EQ(sink.dropped(), 0);
+    }
+
+    for (size_t i = 0; i < 20; ++i)
+    {
+        std::ifstream stream(std::filesystem::path(directory) / (std::to_string(i) + "-graph.dot"));
+        ASSERT_TRUE(stream);
+        std::stringstream text;
+        text << stream.rdbuf();
+        EXPECT_EQ(text.str(), "digraph {" + std::to_string(i) + "}");
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+// Records beyond the ring capacity drop the oldest ones, the rest is written on destruction
+TEST(TraceSinkTest, DropOldest)
+{
+    const std::string directory = "./trace-drop";
+    constexpr size_t capacity = 4;
+    constexpr size_t records = 1000;
+
+    size_t written = 0;
+    {
+        TraceSink sink(directory, 1, capacity);
+
+        for (size_t i = 0; i < records; ++i)
+        {
+            sink.record(i, "graph", std::string(1000, 'x'));
+        }
+
+        sink.flush();
+        written = sink.written();
+        EXPECT_EQ(written + sink.dropped(), records);
+    }
+
+    size_t files = 0;
+    for (const auto& entry: std::filesystem::directory_iterator(directory))
+    {
+        (void)entry;
+        ++files;
+    }
+    EXPECT_EQ(files, written);
+
+    // The last records are never dropped
+    EXPECT_TRUE(std::filesystem::exists(std::filesystem::path(directory) / (std::to_string(records - 1) + "-graph.dot")));
+
+    std::filesystem::remove_all(directory);
+}
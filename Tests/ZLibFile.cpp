@@ -3,6 +3,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <cstdio>
 
 #include "../ZLibFile/ZLibFile.h"
@@ -192,3 +193,37 @@ TEST(ZLibFileTest, ReadWriteUnorderedSet)
         std::remove(fileName);
     }
 }
+
+TEST(ZLibFileTest, ReadWriteVector)
+{
+    for (size_t t = 0; t < 100; ++t)
+    {
+        std::vector<float> v1(rand() % 1000);
+        for (auto& e: v1)
+        {
+            e = rand();
+        }
+
+        {
+            ZLibFile zfile(fileName, true);
+
+            EXPECT_TRUE(zfile.isOpen());
+
+            EXPECT_TRUE(zfile.write(v1));
+        }
+
+        {
+            std::vector<float> v2(rand() % 10);
+
+            ZLibFile zfile(fileName, false);
+
+            EXPECT_TRUE(zfile.isOpen());
+
+            EXPECT_TRUE(zfile.read(v2));
+
+            EXPECT_EQ(v1, v2);
+        }
+
+        std::remove(fileName);
+    }
+}
@@ -3,6 +3,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <zlib.h>
 
@@ -115,6 +116,26 @@ public:
         return true;
     }
 
+    template<typename E>
+    bool write(const std::vector<E>& v)
+    {
+        uint64_t size = v.size();
+        return write(size) && writePtr(v.data(), size);
+    }
+
+    template<typename E>
+    bool read(std::vector<E>& v)
+    {
+        uint64_t size = 0;
+        if (!read(size))
+        {
+            return false;
+        }
+
+        v.resize(size);
+        return readPtr(v.data(), size);
+    }
+
     template<typename E>
     bool write(const std::unordered_set<E>& m)
     {